@@ -0,0 +1,271 @@
+#ifndef Benchmark_h
+#define Benchmark_h
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A small harness shared by the *_benchmark.cpp programs in this folder.
+//
+// Every benchmark program accepts the same command line options:
+//     --threads=1,2,4    thread counts to sweep (default: 1,2,4)
+//     --iterations=N     operations per thread (default: per benchmark)
+//     --filter=TEXT      only run the benchmarks whose name contains TEXT
+//     --json             print one JSON object per result instead of a table
+//     --label=TEXT       tag the results, e.g., with the commit hash
+//     --no-pin           don't pin the threads to CPUs
+//
+// The JSON lines output is meant to be saved and compared across commits:
+//     ./primitives_benchmark --json --label=$(git rev-parse --short HEAD)
+//
+// Usage:
+//     Benchmark bench(argc, argv);
+//     for (size_t threads: bench.options().threads) {
+//         LatencyRecorder latency;
+//         double seconds = bench.run_threads(threads, [&](size_t id) {
+//             ... // Run bench.iterations(DEFAULT) operations and record
+//                 // the latency of some of them
+//         });
+//         bench.report("my_benchmark", {{"param", "value"}}, threads,
+//                      threads * bench.iterations(DEFAULT), seconds, latency);
+//     }
+
+typedef std::chrono::steady_clock BenchmarkClock;
+
+inline uint64_t elapsed_ns(BenchmarkClock::time_point start,
+                           BenchmarkClock::time_point end) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        end - start).count();
+}
+
+// Pin the calling thread to the cpu-th CPU, wrapping around the available
+// ones. Returns false if it's not allowed.
+inline bool pin_current_thread(size_t cpu) {
+    size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % cpus, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+// Collects latency samples in nanoseconds and summarizes them by percentiles.
+// Each thread should use its own LatencyRecorder and merge() them afterwards.
+class LatencyRecorder final {
+public:
+    struct Summary {
+        size_t samples;
+        double mean;
+        uint64_t p50;
+        uint64_t p90;
+        uint64_t p99;
+        uint64_t p999;
+        uint64_t max;
+    };
+
+    void reserve(size_t n) {
+        samples.reserve(n);
+    }
+
+    void add(uint64_t ns) {
+        samples.push_back(ns);
+    }
+
+    void merge(const LatencyRecorder& other) {
+        samples.insert(samples.end(), other.samples.begin(),
+                       other.samples.end());
+    }
+
+    bool empty() const {
+        return samples.empty();
+    }
+
+    Summary summary() {
+        Summary s = {};
+        if (samples.empty()) {
+            return s;
+        }
+        std::sort(samples.begin(), samples.end());
+        s.samples = samples.size();
+        s.mean = 0;
+        for (uint64_t v: samples) {
+            s.mean += static_cast<double>(v) / samples.size();
+        }
+        s.p50 = percentile(50);
+        s.p90 = percentile(90);
+        s.p99 = percentile(99);
+        s.p999 = percentile(99.9);
+        s.max = samples.back();
+        return s;
+    }
+
+private:
+    // samples must be sorted
+    uint64_t percentile(double p) const {
+        size_t rank = static_cast<size_t>(p / 100.0 * (samples.size() - 1));
+        return samples[rank];
+    }
+
+    std::vector<uint64_t> samples;
+};
+
+class Benchmark final {
+public:
+    struct Options {
+        std::vector<size_t> threads = {1, 2, 4};
+        size_t iterations = 0; // 0: use the default of each benchmark
+        std::string filter;
+        std::string label;
+        bool json = false;
+        bool pin = true;
+    };
+
+    typedef std::vector<std::pair<std::string, std::string>> Params;
+
+    Benchmark(int argc, char** argv) {
+        for (int i = 1 ; i < argc ; ++i) {
+            std::string arg(argv[i]);
+            if (arg.rfind("--threads=", 0) == 0) {
+                opts.threads.clear();
+                std::stringstream list(arg.substr(strlen("--threads=")));
+                std::string n;
+                while (std::getline(list, n, ',')) {
+                    opts.threads.push_back(std::max(1ul, std::stoul(n)));
+                }
+            } else if (arg.rfind("--iterations=", 0) == 0) {
+                opts.iterations = std::stoul(arg.substr(strlen("--iterations=")));
+            } else if (arg.rfind("--filter=", 0) == 0) {
+                opts.filter = arg.substr(strlen("--filter="));
+            } else if (arg.rfind("--label=", 0) == 0) {
+                opts.label = arg.substr(strlen("--label="));
+            } else if (arg == "--json") {
+                opts.json = true;
+            } else if (arg == "--no-pin") {
+                opts.pin = false;
+            } else {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+        }
+        if (!opts.json) {
+            std::cout << std::left << std::setw(48) << "benchmark"
+                      << std::right << std::setw(8) << "threads"
+                      << std::setw(14) << "ops/s"
+                      << std::setw(10) << "p50(ns)"
+                      << std::setw(10) << "p90(ns)"
+                      << std::setw(10) << "p99(ns)"
+                      << std::setw(11) << "p99.9(ns)"
+                      << std::setw(12) << "max(ns)" << std::endl;
+        }
+    }
+
+    const Options& options() const {
+        return opts;
+    }
+
+    size_t iterations(size_t default_iterations) const {
+        return opts.iterations ? opts.iterations : default_iterations;
+    }
+
+    bool enabled(const std::string& name) const {
+        return name.find(opts.filter) != std::string::npos;
+    }
+
+    // Pin the thread running the id-th role of a benchmark, if pinning is on
+    void pin(size_t id) const {
+        if (opts.pin) {
+            pin_current_thread(id);
+        }
+    }
+
+    // Run body(id) on threads threads at the same time, where id is in
+    // [0, threads). The threads are pinned to different CPUs if possible.
+    // Returns the seconds from the start signal to the last thread finishing.
+    double run_threads(size_t threads, const std::function<void(size_t)>& body) {
+        std::atomic<size_t> ready(0);
+        std::atomic<bool> go(false);
+        std::vector<std::thread> workers;
+        for (size_t id = 0 ; id < threads ; ++id) {
+            workers.emplace_back([&, id] {
+                pin(id);
+                ready.fetch_add(1);
+                // Start all the threads as near to the same time as possible
+                while (!go.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+                body(id);
+            });
+        }
+        while (ready.load() < threads) {
+            std::this_thread::yield();
+        }
+        BenchmarkClock::time_point start = BenchmarkClock::now();
+        go.store(true, std::memory_order_release);
+        for (std::thread& worker: workers) {
+            worker.join();
+        }
+        return elapsed_ns(start, BenchmarkClock::now()) / 1e9;
+    }
+
+    void report(const std::string& name, const Params& params, size_t threads,
+                uint64_t operations, double seconds, LatencyRecorder& latency) {
+        LatencyRecorder::Summary s = latency.summary();
+        double throughput = seconds > 0 ? operations / seconds : 0;
+        if (opts.json) {
+            std::cout << "{\"benchmark\":\"" << name << "\"";
+            if (!opts.label.empty()) {
+                std::cout << ",\"label\":\"" << opts.label << "\"";
+            }
+            for (const auto& [key, value]: params) {
+                std::cout << ",\"" << key << "\":\"" << value << "\"";
+            }
+            std::cout << ",\"threads\":" << threads
+                      << ",\"operations\":" << operations
+                      << ",\"seconds\":" << seconds
+                      << ",\"ops_per_second\":" << throughput
+                      << ",\"samples\":" << s.samples
+                      << ",\"mean_ns\":" << s.mean
+                      << ",\"p50_ns\":" << s.p50
+                      << ",\"p90_ns\":" << s.p90
+                      << ",\"p99_ns\":" << s.p99
+                      << ",\"p999_ns\":" << s.p999
+                      << ",\"max_ns\":" << s.max << "}" << std::endl;
+            return;
+        }
+        std::string full_name(name);
+        for (const auto& [key, value]: params) {
+            full_name += "/" + key + "=" + value;
+        }
+        std::cout << std::left << std::setw(48) << full_name
+                  << std::right << std::setw(8) << threads
+                  << std::setw(14) << std::fixed << std::setprecision(0)
+                  << throughput;
+        if (s.samples) {
+            std::cout << std::setw(10) << s.p50
+                      << std::setw(10) << s.p90
+                      << std::setw(10) << s.p99
+                      << std::setw(11) << s.p999
+                      << std::setw(12) << s.max;
+        }
+        std::cout << std::endl;
+    }
+
+private:
+    Options opts;
+};
+
+#endif // Benchmark_h
\ No newline at end of file
@@ -0,0 +1,750 @@
+#include "../mutex/data_mutex.h"
+#include "../mutex/futex_mutex.h"
+#include "../mutex/seqlock.h"
+#include "../mutex/sharded_map.h"
+#include "../mutex/spinlock_mutex.h"
+#include "../profiler/execution_tracer.h"
+#include "../ring_buffer/broadcast_ring_buffer.h"
+#include "../ring_buffer/overwrite_ring_buffer.h"
+#include "../ring_buffer/ring_buffer.h"
+#include "../task_queue/simple_serial_task_queue.h"
+#include "../task_queue/task_queue.h"
+#include "benchmark.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Record the latency of one in every SAMPLE_INTERVAL operations so reading
+// the clock doesn't dominate the measured throughput
+const size_t SAMPLE_INTERVAL = 64;
+
+template<size_t N>
+struct Payload {
+    char bytes[N];
+};
+
+// N threads keep taking the same lock to increase a shared counter
+template<class M>
+void bench_lock(Benchmark& bench, const std::string& name) {
+    if (!bench.enabled(name)) {
+        return;
+    }
+    const size_t iterations = bench.iterations(200000);
+    for (size_t threads: bench.options().threads) {
+        M mutex;
+        uint64_t counter = 0; // Protected by mutex
+        std::vector<LatencyRecorder> latencies(threads);
+        double seconds = bench.run_threads(threads, [&](size_t id) {
+            latencies[id].reserve(iterations / SAMPLE_INTERVAL + 1);
+            for (size_t i = 0 ; i < iterations ; ++i) {
+                if (i % SAMPLE_INTERVAL) {
+                    mutex.lock();
+                    ++counter;
+                    mutex.unlock();
+                    continue;
+                }
+                BenchmarkClock::time_point start = BenchmarkClock::now();
+                mutex.lock();
+                latencies[id].add(elapsed_ns(start, BenchmarkClock::now()));
+                ++counter;
+                mutex.unlock();
+            }
+        });
+        assert(counter == threads * iterations);
+        for (size_t id = 1 ; id < threads ; ++id) {
+            latencies[0].merge(latencies[id]);
+        }
+        bench.report(name, {}, threads, threads * iterations, seconds,
+                     latencies[0]);
+    }
+}
+
+// Spin for about n * 2ns, without touching the shared memory
+void busy_work(size_t n) {
+    volatile uint64_t x = 0;
+    for (size_t i = 0 ; i < n ; ++i) {
+        x = x * 31 + i;
+    }
+}
+
+// Threads take a lock for a ~100ns critical section, with ~200ns of work
+// between, with half as many threads as CPUs (under) and 4x as many (over).
+// Oversubscribed, a holder gets preempted and the waiters have to stop
+// spinning to let it run again.
+template<class M>
+void bench_lock_subscription(Benchmark& bench, const std::string& mutex_name) {
+    const std::string name("lock_subscription");
+    if (!bench.enabled(name)) {
+        return;
+    }
+    const size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+    const size_t iterations = bench.iterations(50000);
+    for (const std::string load: {"under", "over"}) {
+        size_t threads = load == "under" ? std::max<size_t>(1, cpus / 2) : 4 * cpus;
+        M mutex;
+        uint64_t counter = 0; // Protected by mutex
+        std::vector<LatencyRecorder> latencies(threads);
+        double seconds = bench.run_threads(threads, [&](size_t id) {
+            latencies[id].reserve(iterations / SAMPLE_INTERVAL + 1);
+            for (size_t i = 0 ; i < iterations ; ++i) {
+                busy_work(100);
+                if (i % SAMPLE_INTERVAL) {
+                    mutex.lock();
+                    ++counter;
+                    busy_work(50);
+                    mutex.unlock();
+                    continue;
+                }
+                BenchmarkClock::time_point start = BenchmarkClock::now();
+                mutex.lock();
+                latencies[id].add(elapsed_ns(start, BenchmarkClock::now()));
+                ++counter;
+                busy_work(50);
+                mutex.unlock();
+            }
+        });
+        assert(counter == threads * iterations);
+        for (size_t id = 1 ; id < threads ; ++id) {
+            latencies[0].merge(latencies[id]);
+        }
+        bench.report(name, {{"mutex", mutex_name}, {"load", load}}, threads,
+                     threads * iterations, seconds, latencies[0]);
+    }
+}
+
+// N threads keep locking the same DataMutex to increase the data in it
+template<class M>
+void bench_data_mutex(Benchmark& bench, const std::string& name) {
+    if (!bench.enabled(name)) {
+        return;
+    }
+    const size_t iterations = bench.iterations(200000);
+    for (size_t threads: bench.options().threads) {
+        DataMutex<uint64_t, M> data(0);
+        std::vector<LatencyRecorder> latencies(threads);
+        double seconds = bench.run_threads(threads, [&](size_t id) {
+            latencies[id].reserve(iterations / SAMPLE_INTERVAL + 1);
+            for (size_t i = 0 ; i < iterations ; ++i) {
+                if (i % SAMPLE_INTERVAL) {
+                    data.lock().data() += 1;
+                    continue;
+                }
+                BenchmarkClock::time_point start = BenchmarkClock::now();
+                auto guard = data.lock();
+                latencies[id].add(elapsed_ns(start, BenchmarkClock::now()));
+                guard.data() += 1;
+            }
+        });
+        assert(data.lock().data() == threads * iterations);
+        for (size_t id = 1 ; id < threads ; ++id) {
+            latencies[0].merge(latencies[id]);
+        }
+        bench.report(name, {}, threads, threads * iterations, seconds,
+                     latencies[0]);
+    }
+}
+
+// The common DataMutex<std::unordered_map> pattern, for comparison with
+// ShardedMap
+struct LockedUnorderedMap {
+    DataMutex<std::unordered_map<uint64_t, uint64_t>> map {
+        std::unordered_map<uint64_t, uint64_t>()
+    };
+
+    bool find(uint64_t key) {
+        auto guard = map.lock();
+        return guard.data().count(key);
+    }
+
+    void update(uint64_t key) {
+        ++map.lock().data()[key];
+    }
+};
+
+struct ShardedCounterMap {
+    ShardedMap<uint64_t, uint64_t> map;
+
+    bool find(uint64_t key) {
+        return map.find(key).has_value();
+    }
+
+    void update(uint64_t key) {
+        map.update(key, [](uint64_t& n) { ++n; });
+    }
+};
+
+// N threads look up random keys of a map of 16K keys and update one in every
+// 5 of them
+template<class Map>
+void bench_map(Benchmark& bench, const std::string& map_name) {
+    const std::string name("map_lookup_update");
+    if (!bench.enabled(name)) {
+        return;
+    }
+    const uint64_t keys = 16384;
+    const size_t iterations = bench.iterations(200000);
+    for (size_t threads: bench.options().threads) {
+        Map map;
+        for (uint64_t key = 0 ; key < keys ; ++key) {
+            map.update(key);
+        }
+        std::vector<LatencyRecorder> latencies(threads);
+        double seconds = bench.run_threads(threads, [&](size_t id) {
+            latencies[id].reserve(iterations / SAMPLE_INTERVAL + 1);
+            uint64_t random = 0x9e3779b97f4a7c15ull * (id + 1);
+            for (size_t i = 0 ; i < iterations ; ++i) {
+                // xorshift64
+                random ^= random << 13;
+                random ^= random >> 7;
+                random ^= random << 17;
+                uint64_t key = random % keys;
+                BenchmarkClock::time_point start;
+                if (i % SAMPLE_INTERVAL == 0) {
+                    start = BenchmarkClock::now();
+                }
+                if (i % 5) {
+                    bool found = map.find(key);
+                    assert(found);
+                    (void)found;
+                } else {
+                    map.update(key);
+                }
+                if (i % SAMPLE_INTERVAL == 0) {
+                    latencies[id].add(elapsed_ns(start, BenchmarkClock::now()));
+                }
+            }
+        });
+        for (size_t id = 1 ; id < threads ; ++id) {
+            latencies[0].merge(latencies[id]);
+        }
+        bench.report(name, {{"map", map_name}}, threads, threads * iterations,
+                     seconds, latencies[0]);
+    }
+}
+
+// One producer writes the elements one by one and one consumer drains them
+// by read_all(). The latency is the time spent in each write() call.
+template<size_t N>
+void bench_ring_buffer_throughput(Benchmark& bench) {
+    const std::string name("spsc_ring_buffer_throughput");
+    if (!bench.enabled(name)) {
+        return;
+    }
+    typedef Payload<N> Element;
+    const size_t iterations = bench.iterations(200000);
+    SPSCRingBuffer<Element> ring(1024);
+    LatencyRecorder latency;
+    latency.reserve(iterations / SAMPLE_INTERVAL + 1);
+    double seconds = bench.run_threads(2, [&](size_t id) {
+        if (id == 0) { // Producer
+            Element e = {};
+            for (size_t i = 0 ; i < iterations ; ++i) {
+                bool sample = i % SAMPLE_INTERVAL == 0;
+                BenchmarkClock::time_point start;
+                if (sample) {
+                    start = BenchmarkClock::now();
+                }
+                while (ring.write(e) == 0) {
+                    std::this_thread::yield();
+                }
+                if (sample) {
+                    latency.add(elapsed_ns(start, BenchmarkClock::now()));
+                }
+            }
+        } else { // Consumer
+            size_t received = 0;
+            while (received < iterations) {
+                size_t n = ring.read_all().size();
+                if (n == 0) {
+                    std::this_thread::yield();
+                }
+                received += n;
+            }
+        }
+    });
+    bench.report(name, {{"element_bytes", std::to_string(N)}}, 2, iterations,
+                 seconds, latency);
+}
+
+// Two threads ping-pong one element through two rings
+template<size_t N>
+void bench_ring_buffer_round_trip(Benchmark& bench) {
+    const std::string name("spsc_ring_buffer_round_trip");
+    if (!bench.enabled(name)) {
+        return;
+    }
+    typedef Payload<N> Element;
+    const size_t iterations = bench.iterations(20000);
+    SPSCRingBuffer<Element> ping(16);
+    SPSCRingBuffer<Element> pong(16);
+    LatencyRecorder latency;
+    latency.reserve(iterations);
+    double seconds = bench.run_threads(2, [&](size_t id) {
+        Element e = {};
+        SPSCRingBuffer<Element>& in = id == 0 ? pong : ping;
+        SPSCRingBuffer<Element>& out = id == 0 ? ping : pong;
+        for (size_t i = 0 ; i < iterations ; ++i) {
+            BenchmarkClock::time_point start = BenchmarkClock::now();
+            if (id == 0) {
+                out.write(e);
+            }
+            std::optional<Element> r;
+            while (!(r = in.read())) {
+                std::this_thread::yield();
+            }
+            if (id == 0) {
+                latency.add(elapsed_ns(start, BenchmarkClock::now()));
+            } else {
+                out.write(*r);
+            }
+        }
+    });
+    bench.report(name, {{"element_bytes", std::to_string(N)}}, 2, iterations,
+                 seconds, latency);
+}
+
+// One producer fans a stream out to 1, 2, 4 and 8 consumers, either through
+// one BroadcastRingBuffer or by copying every element into one SPSCRingBuffer
+// per consumer. The latency is the time the producer spends publishing one
+// element to all the consumers. The elements are 64 bytes.
+const size_t FAN_OUT_CONSUMERS[] = { 1, 2, 4, 8 };
+
+void bench_fan_out_broadcast_ring(Benchmark& bench) {
+    const std::string name("fan_out_broadcast_ring");
+    if (!bench.enabled(name)) {
+        return;
+    }
+    typedef Payload<64> Element;
+    const size_t iterations = bench.iterations(100000);
+    for (size_t consumers: FAN_OUT_CONSUMERS) {
+        BroadcastRingBuffer<Element> ring(1024, consumers);
+        LatencyRecorder latency;
+        latency.reserve(iterations / SAMPLE_INTERVAL + 1);
+        double seconds = bench.run_threads(consumers + 1, [&](size_t id) {
+            if (id == 0) { // Producer
+                Element e = {};
+                for (size_t i = 0 ; i < iterations ; ++i) {
+                    bool sample = i % SAMPLE_INTERVAL == 0;
+                    BenchmarkClock::time_point start;
+                    if (sample) {
+                        start = BenchmarkClock::now();
+                    }
+                    while (ring.write(e) == 0) {
+                        std::this_thread::yield();
+                    }
+                    if (sample) {
+                        latency.add(elapsed_ns(start, BenchmarkClock::now()));
+                    }
+                }
+                return;
+            }
+            size_t consumer = id - 1;
+            size_t received = 0;
+            while (received < iterations) {
+                BroadcastRingBuffer<Element>::Batch b =
+                    ring.claim_read(consumer);
+                if (b.size == 0) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                ring.commit_read(consumer, b.size);
+                received += b.size;
+            }
+        });
+        bench.report(name, {{"consumers", std::to_string(consumers)}},
+                     consumers + 1, iterations, seconds, latency);
+    }
+}
+
+void bench_fan_out_spsc_rings(Benchmark& bench) {
+    const std::string name("fan_out_spsc_rings");
+    if (!bench.enabled(name)) {
+        return;
+    }
+    typedef Payload<64> Element;
+    const size_t iterations = bench.iterations(100000);
+    for (size_t consumers: FAN_OUT_CONSUMERS) {
+        std::vector<std::unique_ptr<SPSCRingBuffer<Element>>> rings;
+        for (size_t c = 0 ; c < consumers ; ++c) {
+            rings.emplace_back(new SPSCRingBuffer<Element>(1024));
+        }
+        LatencyRecorder latency;
+        latency.reserve(iterations / SAMPLE_INTERVAL + 1);
+        double seconds = bench.run_threads(consumers + 1, [&](size_t id) {
+            if (id == 0) { // Producer
+                Element e = {};
+                for (size_t i = 0 ; i < iterations ; ++i) {
+                    bool sample = i % SAMPLE_INTERVAL == 0;
+                    BenchmarkClock::time_point start;
+                    if (sample) {
+                        start = BenchmarkClock::now();
+                    }
+                    for (auto& ring: rings) {
+                        while (ring->write(e) == 0) {
+                            std::this_thread::yield();
+                        }
+                    }
+                    if (sample) {
+                        latency.add(elapsed_ns(start, BenchmarkClock::now()));
+                    }
+                }
+                return;
+            }
+            SPSCRingBuffer<Element>& ring = *rings[id - 1];
+            size_t received = 0;
+            while (received < iterations) {
+                size_t n = ring.read_all().size();
+                if (n == 0) {
+                    std::this_thread::yield();
+                }
+                received += n;
+            }
+        });
+        bench.report(name, {{"consumers", std::to_string(consumers)}},
+                     consumers + 1, iterations, seconds, latency);
+    }
+}
+
+// A producer writes as fast as it can while the consumer drains the ring at
+// a slower pace, so the ring keeps getting full. SPSCRingBuffer drops the
+// newest data then, and OverwriteSPSCRingBuffer drops the oldest. The latency
+// is the time spent in each write() call.
+template<class Ring>
+size_t drain_slowly(Ring& ring, const std::atomic<bool>& done) {
+    size_t received = 0;
+    while (true) {
+        bool finished = done;
+        size_t n = ring.read_all().size();
+        received += n;
+        if (finished && n == 0) {
+            return received;
+        }
+        // Pretend to process the data
+        for (volatile size_t i = 0 ; i < 200 * n ; i = i + 1);
+        std::this_thread::yield();
+    }
+}
+
+template<class Ring>
+void bench_lossy_ring(Benchmark& bench, const std::string& name) {
+    if (!bench.enabled(name)) {
+        return;
+    }
+    const size_t iterations = bench.iterations(200000);
+    Ring ring(1024);
+    std::atomic<bool> done(false);
+    size_t received = 0;
+    LatencyRecorder latency;
+    latency.reserve(iterations / SAMPLE_INTERVAL + 1);
+    double seconds = bench.run_threads(2, [&](size_t id) {
+        if (id == 1) { // Consumer
+            received = drain_slowly(ring, done);
+            return;
+        }
+        for (size_t i = 0 ; i < iterations ; ++i) {
+            if (i % SAMPLE_INTERVAL) {
+                ring.write(i);
+                continue;
+            }
+            BenchmarkClock::time_point start = BenchmarkClock::now();
+            ring.write(i);
+            latency.add(elapsed_ns(start, BenchmarkClock::now()));
+        }
+        done = true;
+    });
+    bench.report(name, {{"delivered", std::to_string(received)}}, 2,
+                 iterations, seconds, latency);
+}
+
+// One writer keeps publishing the latest quote while N readers keep loading
+// it. The latency is the time of one load by a reader.
+struct Quote {
+    uint64_t id;
+    double bid;
+    double ask;
+    uint64_t volume;
+};
+
+template<class Cell, class Store, class Load>
+void bench_latest_value(Benchmark& bench, const std::string& name, Store store,
+                        Load load) {
+    if (!bench.enabled(name)) {
+        return;
+    }
+    const size_t iterations = bench.iterations(200000);
+    for (size_t readers: bench.options().threads) {
+        Cell cell(Quote {});
+        std::atomic<size_t> running(readers);
+        uint64_t updates = 0;
+        std::vector<LatencyRecorder> latencies(readers);
+        double seconds = bench.run_threads(readers + 1, [&](size_t id) {
+            if (id == readers) { // Writer
+                for (uint64_t i = 1 ; running ; ++i) {
+                    store(cell, Quote { i, i * 0.25, i * 0.25 + 1, i });
+                    updates = i;
+                }
+                return;
+            }
+            latencies[id].reserve(iterations / SAMPLE_INTERVAL + 1);
+            // Start once the writer is running
+            while (load(cell).id == 0) {
+                std::this_thread::yield();
+            }
+            uint64_t checksum = 0;
+            for (size_t i = 0 ; i < iterations ; ++i) {
+                if (i % SAMPLE_INTERVAL) {
+                    checksum += load(cell).id;
+                    continue;
+                }
+                BenchmarkClock::time_point start = BenchmarkClock::now();
+                Quote q = load(cell);
+                latencies[id].add(elapsed_ns(start, BenchmarkClock::now()));
+                assert(q.ask == q.bid + 1);
+                checksum += q.id;
+            }
+            --running;
+            // Keep the loads from being optimized out
+            volatile uint64_t sink = checksum;
+            (void) sink;
+        });
+        for (size_t id = 1 ; id < readers ; ++id) {
+            latencies[0].merge(latencies[id]);
+        }
+        bench.report(name, {{"writer_updates", std::to_string(updates)}},
+                     readers + 1, readers * iterations, seconds, latencies[0]);
+    }
+}
+
+void bench_latest_values(Benchmark& bench) {
+    bench_latest_value<SeqLock<Quote>>(
+        bench, "latest_value_seqlock",
+        [](SeqLock<Quote>& cell, const Quote& q) { cell.store(q); },
+        [](SeqLock<Quote>& cell) { return cell.load(); });
+    bench_latest_value<DataMutex<Quote>>(
+        bench, "latest_value_data_mutex",
+        [](DataMutex<Quote>& cell, const Quote& q) { cell.lock().data() = q; },
+        [](DataMutex<Quote>& cell) { return cell.lock().data(); });
+    bench_latest_value<DataMutex<Quote, SpinlockMutex>>(
+        bench, "latest_value_data_mutex_spinlock",
+        [](DataMutex<Quote, SpinlockMutex>& cell, const Quote& q) {
+            cell.lock().data() = q;
+        },
+        [](DataMutex<Quote, SpinlockMutex>& cell) { return cell.lock().data(); });
+}
+
+// The calling thread dispatches trivial tasks to a TaskQueue with N workers.
+// The latency is from dispatch() to the task starting.
+void bench_task_queue(Benchmark& bench) {
+    const std::string name("task_queue_dispatch");
+    if (!bench.enabled(name)) {
+        return;
+    }
+    const size_t tasks = bench.iterations(50000);
+    for (size_t threads: bench.options().threads) {
+        std::vector<uint64_t> latencies(tasks);
+        std::vector<std::future<void>> futures;
+        futures.reserve(tasks);
+        BenchmarkClock::time_point start;
+        {
+            TaskQueue q(threads);
+            start = BenchmarkClock::now();
+            for (size_t i = 0 ; i < tasks ; ++i) {
+                BenchmarkClock::time_point dispatched = BenchmarkClock::now();
+                futures.emplace_back(q.dispatch([&latencies, i, dispatched] {
+                    latencies[i] = elapsed_ns(dispatched,
+                                              BenchmarkClock::now());
+                }));
+            }
+            for (std::future<void>& f: futures) {
+                f.wait();
+            }
+        }
+        double seconds = elapsed_ns(start, BenchmarkClock::now()) / 1e9;
+        LatencyRecorder latency;
+        for (uint64_t ns: latencies) {
+            latency.add(ns);
+        }
+        bench.report(name, {}, threads, tasks, seconds, latency);
+    }
+}
+
+// Tasks of work (cpu: ~20us of arithmetic, block: a 200us sleep in a
+// BlockingRegion) on a TaskQueue with 1x, 2x and 4x as many workers as CPUs,
+// and on an elastic one growing from 1x up to 4x. The latency is from
+// dispatch() to the task starting.
+void bench_task_queue_oversubscription(Benchmark& bench) {
+    const std::string name("task_queue_oversub");
+    if (!bench.enabled(name)) {
+        return;
+    }
+    const size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+    const size_t tasks = bench.iterations(5000);
+    for (const std::string work: {"cpu", "block"}) {
+        auto task = [&work] {
+            if (work == "block") {
+                TaskQueue::BlockingRegion region;
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                return;
+            }
+            volatile uint64_t x = 0;
+            for (size_t i = 0 ; i < 10000 ; ++i) {
+                x = x * 31 + i;
+            }
+        };
+        for (size_t factor: {1, 2, 4, 0}) {
+            std::vector<uint64_t> latencies(tasks);
+            std::vector<std::future<void>> futures;
+            futures.reserve(tasks);
+            BenchmarkClock::time_point start;
+            size_t workers;
+            {
+                std::unique_ptr<TaskQueue> q(factor
+                    ? new TaskQueue(factor * cpus)
+                    : new TaskQueue(cpus, 4 * cpus, std::chrono::milliseconds(100)));
+                start = BenchmarkClock::now();
+                for (size_t i = 0 ; i < tasks ; ++i) {
+                    BenchmarkClock::time_point dispatched = BenchmarkClock::now();
+                    futures.emplace_back(q->dispatch([&latencies, &task, i, dispatched] {
+                        latencies[i] = elapsed_ns(dispatched,
+                                                  BenchmarkClock::now());
+                        task();
+                    }));
+                }
+                for (std::future<void>& f: futures) {
+                    f.wait();
+                }
+                workers = q->worker_count();
+            }
+            double seconds = elapsed_ns(start, BenchmarkClock::now()) / 1e9;
+            LatencyRecorder latency;
+            for (uint64_t ns: latencies) {
+                latency.add(ns);
+            }
+            bench.report(name, {{"work", work},
+                                {"workers", factor ? std::to_string(factor) + "x"
+                                                   : "elastic"}},
+                         workers, tasks, seconds, latency);
+        }
+    }
+}
+
+void bench_simple_serial_task_queue(Benchmark& bench) {
+    const std::string name("simple_serial_task_queue_dispatch");
+    if (!bench.enabled(name)) {
+        return;
+    }
+    const size_t tasks = bench.iterations(50000);
+    std::vector<uint64_t> latencies(tasks);
+    BenchmarkClock::time_point start;
+    {
+        SimpleSerialTaskQueue q;
+        start = BenchmarkClock::now();
+        for (size_t i = 0 ; i < tasks ; ++i) {
+            BenchmarkClock::time_point dispatched = BenchmarkClock::now();
+            q.dispatch([&latencies, i, dispatched] {
+                latencies[i] = elapsed_ns(dispatched, BenchmarkClock::now());
+            });
+        }
+        q.wait();
+    }
+    double seconds = elapsed_ns(start, BenchmarkClock::now()) / 1e9;
+    LatencyRecorder latency;
+    for (uint64_t ns: latencies) {
+        latency.add(ns);
+    }
+    bench.report(name, {}, 1, tasks, seconds, latency);
+}
+
+// One thread keeps recording events, as the EXECUTION_TRACE(...) hooks of a
+// -DEXECUTION_TRACER build do, with the tracer stopped or running. Each batch
+// fills a quarter of the ring and the collector drains it between the
+// batches, so the events are recorded rather than dropped. The latency is the
+// mean time of one event in a batch. "clock" is the timestamp alone.
+void bench_execution_tracer(Benchmark& bench) {
+    const std::string name("execution_tracer_record");
+    if (!bench.enabled(name)) {
+        return;
+    }
+    const size_t batch = ExecutionTracer::RING_CAPACITY / 4;
+    const size_t batches = std::max<size_t>(
+        1, bench.iterations(20 * batch) / batch);
+    int object = 0;
+    for (const std::string state: {"clock", "stopped", "running"}) {
+        bool clock_only = state == "clock";
+        if (state == "running" && !ExecutionTracer::start("/dev/null")) {
+            std::cerr << "Can't start the execution tracer" << std::endl;
+            return;
+        }
+        LatencyRecorder latency;
+        uint64_t total_ns = 0;
+        uint64_t ticks = 0;
+        for (size_t i = 0 ; i < batches ; ++i) {
+            BenchmarkClock::time_point start = BenchmarkClock::now();
+            if (clock_only) {
+                for (size_t j = 0 ; j < batch ; ++j) {
+                    ticks += ExecutionTracer::now_ticks();
+                }
+            } else {
+                for (size_t j = 0 ; j < batch ; ++j) {
+                    ExecutionTracer::record(TraceEventType::Enqueue, &object);
+                }
+            }
+            uint64_t ns = elapsed_ns(start, BenchmarkClock::now());
+            total_ns += ns;
+            latency.add(ns / batch);
+            std::this_thread::sleep_for(5 * ExecutionTracer::COLLECT_PERIOD);
+        }
+        // Keep the clock reads from being optimized away
+        if (ticks == 1) {
+            std::cout << ticks << std::endl;
+        }
+        uint64_t dropped = ExecutionTracer::stop();
+        bench.report(name, {{"state", state}, {"dropped", std::to_string(dropped)}},
+                     1, batches * batch, total_ns / 1e9, latency);
+    }
+}
+
+int main(int argc, char** argv) {
+    Benchmark bench(argc, argv);
+
+    bench_lock<SpinlockMutex>(bench, "spinlock_mutex");
+    bench_lock<std::mutex>(bench, "std_mutex");
+    bench_lock<FutexMutex>(bench, "futex_mutex");
+    bench_data_mutex<std::mutex>(bench, "data_mutex");
+    bench_data_mutex<SpinlockMutex>(bench, "data_mutex_spinlock");
+    bench_data_mutex<FutexMutex>(bench, "data_mutex_futex");
+    bench_lock_subscription<SpinlockMutex>(bench, "spinlock");
+    bench_lock_subscription<std::mutex>(bench, "std");
+    bench_lock_subscription<FutexMutex>(bench, "futex");
+    bench_map<LockedUnorderedMap>(bench, "data_mutex");
+    bench_map<ShardedCounterMap>(bench, "sharded");
+
+    bench_ring_buffer_throughput<8>(bench);
+    bench_ring_buffer_throughput<64>(bench);
+    bench_ring_buffer_throughput<256>(bench);
+    bench_ring_buffer_round_trip<8>(bench);
+    bench_ring_buffer_round_trip<64>(bench);
+    bench_ring_buffer_round_trip<256>(bench);
+    bench_fan_out_broadcast_ring(bench);
+    bench_fan_out_spsc_rings(bench);
+    bench_lossy_ring<SPSCRingBuffer<uint64_t>>(bench, "lossy_ring_drop_newest");
+    bench_lossy_ring<OverwriteSPSCRingBuffer<uint64_t>>(bench,
+                                                        "lossy_ring_drop_oldest");
+    bench_latest_values(bench);
+
+    bench_task_queue(bench);
+    bench_task_queue_oversubscription(bench);
+    bench_simple_serial_task_queue(bench);
+
+    bench_execution_tracer(bench);
+
+    return 0;
+}
\ No newline at end of file
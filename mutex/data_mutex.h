@@ -4,6 +4,31 @@
 #include <cassert>
 #include <cstdio>
 #include <mutex>
+#include <tuple>
+
+#ifdef DATA_MUTEX_DEBUG
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <set>
+#include <utility>
+#include <vector>
+#endif
+
+#ifdef CONTENTION_PROFILER
+#include "../profiler/contention_profiler.h"
+#endif
+
+#ifdef EXECUTION_TRACER
+#include "../profiler/execution_tracer.h"
+#endif
+
+// A hook recording an event for profiler/execution_tracer.h. Compiled out
+// unless EXECUTION_TRACER is defined.
+#ifndef EXECUTION_TRACE
+#define EXECUTION_TRACE(type, object)
+#endif
 
 // This is a Rust-style mutex [1] written in C++
 // Usage:
@@ -19,13 +44,126 @@
 //        assert(guard.data(), 101);
 //    } // Leave critical section
 //
+// The underlying lock type can be any Lockable type (lock(), try_lock() and
+// unlock()), e.g., DataMutex<uint32_t, SpinlockMutex>.
+//
+// When several DataMutex are needed at once, use lock_all(...) instead of
+// nesting lock() calls. It acquires all the locks without deadlock, in the
+// same way std::scoped_lock does:
+//
+//    DataMutex<int> a(1);
+//    DataMutex<int, SpinlockMutex> b(2);
+//    {
+//        auto [ga, gb] = lock_all(a, b); // Enter critical sections
+//        ga.data() += gb.data();
+//    } // Leave critical sections
+//
+// Define DATA_MUTEX_DEBUG before including this file to record the lock
+// acquisition order and the wait and hold times of every DataMutex instance.
+// See LockOrderRecorder and DataMutex::stats() below.
+//
+// Define CONTENTION_PROFILER to record the acquisition latencies of all the
+// DataMutex instances into ContentionProfiler.
+//
 // [1] https://doc.rust-lang.org/std/sync/struct.Mutex.html
-template<class T>
+
+#ifdef DATA_MUTEX_DEBUG
+// LockOrderRecorder
+//     Records the order in which DataMutex instances are acquired. Every time a
+//     thread acquires a DataMutex while holding others, an edge from each held
+//     instance to the acquired one is recorded. If the reversed edge has been
+//     seen before, the two instances have been acquired in both orders, which
+//     is a potential deadlock, and the pair is recorded as a violation.
+//
+//     Instances acquired together by lock_all(...) don't create edges between
+//     themselves since they are acquired in a deadlock-free way.
+class LockOrderRecorder final {
+public:
+    typedef uint64_t Id;
+    typedef std::pair<Id, Id> Edge; // (held, acquired)
+
+    static LockOrderRecorder& get() {
+        static LockOrderRecorder recorder;
+        return recorder;
+    }
+
+    Id next_id() {
+        return ids.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Called right after the locks in acquired are taken on current thread
+    void on_acquire(const Id* acquired, size_t count) {
+        std::vector<Id>& held = held_by_this_thread();
+        if (!held.empty()) {
+            std::lock_guard<std::mutex> guard(mutex); // Enter critical section
+            for (Id h: held) {
+                for (size_t i = 0 ; i < count ; ++i) {
+                    edges.emplace(h, acquired[i]);
+                    if (edges.count(Edge(acquired[i], h))) {
+                        violations.emplace(std::min(h, acquired[i]),
+                                           std::max(h, acquired[i]));
+                    }
+                }
+            }
+        } // Leave critical section
+        held.insert(held.end(), acquired, acquired + count);
+    }
+
+    // Called right before the lock is released on current thread
+    void on_release(Id id) {
+        std::vector<Id>& held = held_by_this_thread();
+        auto it = std::find(held.rbegin(), held.rend(), id);
+        assert(it != held.rend());
+        held.erase(std::next(it).base());
+    }
+
+    std::set<Edge> lock_order_edges() {
+        std::lock_guard<std::mutex> guard(mutex); // Enter critical section
+        return edges;
+    } // Leave critical section
+
+    // Pairs of instances, (smaller id, larger id), acquired in both orders
+    std::set<Edge> lock_order_violations() {
+        std::lock_guard<std::mutex> guard(mutex); // Enter critical section
+        return violations;
+    } // Leave critical section
+
+    void reset() {
+        std::lock_guard<std::mutex> guard(mutex); // Enter critical section
+        edges.clear();
+        violations.clear();
+    } // Leave critical section
+
+private:
+    LockOrderRecorder(): ids(0) {}
+
+    static std::vector<Id>& held_by_this_thread() {
+        thread_local std::vector<Id> held;
+        return held;
+    }
+
+    std::atomic<Id> ids;
+    std::mutex mutex;
+    std::set<Edge> edges; // Protected by mutex
+    std::set<Edge> violations; // Protected by mutex
+};
+#endif // DATA_MUTEX_DEBUG
+
+template<class T, class M> class DataMutex;
+
+template<class... Ms>
+std::tuple<typename Ms::MutexGuard...> lock_all(Ms&... mutexes);
+
+template<class T, class M = std::mutex>
 class DataMutex final {
 public:
-    // Prefer allocating the shared resource inside this class directly, by 
+    // Prefer allocating the shared resource inside this class directly, by
     // move constructor, to prevent accessing the resource without lock.
-    explicit DataMutex(T&& d): data(d) {}
+    explicit DataMutex(T&& d): data(d) {
+#ifdef DATA_MUTEX_DEBUG
+        debug.id = LockOrderRecorder::get().next_id();
+#endif
+    }
     ~DataMutex() = default;
 
     // RAII style lock returned from DataMutex::lock().
@@ -37,6 +175,10 @@ public:
 
         ~MutexGuard() {
             if (owner) {
+#ifdef DATA_MUTEX_DEBUG
+                owner->on_release();
+#endif
+                EXECUTION_TRACE(LockRelease, owner);
                 owner->mutex.unlock();
             }
         }
@@ -46,23 +188,164 @@ public:
         }
     private:
         friend class DataMutex;
+        template<class... Ms>
+        friend std::tuple<typename Ms::MutexGuard...> lock_all(Ms&... mutexes);
         MutexGuard(const MutexGuard& other) = delete;
 
-        explicit MutexGuard(DataMutex<T>* o):owner(o) {
+        explicit MutexGuard(DataMutex<T, M>* o):owner(o) {
+            assert(owner);
+#ifdef DATA_MUTEX_DEBUG
+            auto start = std::chrono::steady_clock::now();
+            owner->lock_mutex();
+            owner->on_acquire(start);
+            LockOrderRecorder::get().on_acquire(&owner->debug.id, 1);
+#else
+            owner->lock_mutex();
+#endif
+        }
+
+        // The mutex of o has been locked by the caller
+        MutexGuard(DataMutex<T, M>* o, std::adopt_lock_t):owner(o) {
             assert(owner);
-            owner->mutex.lock();
         }
 
-        DataMutex<T>* owner;
+        DataMutex<T, M>* owner;
     };
 
     MutexGuard lock() {
         return MutexGuard(this);
     }
 
+#ifdef DATA_MUTEX_DEBUG
+    struct Stats {
+        uint64_t id; // Id used in LockOrderRecorder
+        uint64_t acquisitions;
+        std::chrono::nanoseconds total_wait;
+        std::chrono::nanoseconds max_wait;
+        std::chrono::nanoseconds total_hold;
+        std::chrono::nanoseconds max_hold;
+    };
+
+    Stats stats() const {
+        return Stats {
+            debug.id,
+            debug.acquisitions.load(std::memory_order_relaxed),
+            std::chrono::nanoseconds(
+                debug.total_wait_ns.load(std::memory_order_relaxed)),
+            std::chrono::nanoseconds(
+                debug.max_wait_ns.load(std::memory_order_relaxed)),
+            std::chrono::nanoseconds(
+                debug.total_hold_ns.load(std::memory_order_relaxed)),
+            std::chrono::nanoseconds(
+                debug.max_hold_ns.load(std::memory_order_relaxed)),
+        };
+    }
+#endif
+
 private:
-    std::mutex mutex;
+    template<class... Ms>
+    friend std::tuple<typename Ms::MutexGuard...> lock_all(Ms&... mutexes);
+
+    void lock_mutex() {
+#ifdef CONTENTION_PROFILER
+        uint64_t start = ContentionProfiler::now_ns();
+        mutex.lock();
+        ContentionProfiler::record(ProfileMetric::DataMutexAcquireLatency,
+                                   ContentionProfiler::now_ns() - start);
+#else
+        mutex.lock();
+#endif
+        EXECUTION_TRACE(LockAcquire, this);
+    }
+
+#ifdef DATA_MUTEX_DEBUG
+    typedef std::chrono::steady_clock Clock;
+
+    // Runs right after mutex is locked. The counters are only written with
+    // the mutex held, but they can be read by stats() at any time.
+    void on_acquire(Clock::time_point wait_start) {
+        debug.acquired_at = Clock::now();
+        uint64_t wait = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            debug.acquired_at - wait_start).count();
+        debug.acquisitions.fetch_add(1, std::memory_order_relaxed);
+        debug.total_wait_ns.fetch_add(wait, std::memory_order_relaxed);
+        if (wait > debug.max_wait_ns.load(std::memory_order_relaxed)) {
+            debug.max_wait_ns.store(wait, std::memory_order_relaxed);
+        }
+    }
+
+    // Runs right before mutex is unlocked
+    void on_release() {
+        uint64_t hold = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - debug.acquired_at).count();
+        debug.total_hold_ns.fetch_add(hold, std::memory_order_relaxed);
+        if (hold > debug.max_hold_ns.load(std::memory_order_relaxed)) {
+            debug.max_hold_ns.store(hold, std::memory_order_relaxed);
+        }
+        LockOrderRecorder::get().on_release(debug.id);
+    }
+
+    struct Debug {
+        uint64_t id = 0;
+        Clock::time_point acquired_at; // Protected by mutex
+        std::atomic<uint64_t> acquisitions{0};
+        std::atomic<uint64_t> total_wait_ns{0};
+        std::atomic<uint64_t> max_wait_ns{0};
+        std::atomic<uint64_t> total_hold_ns{0};
+        std::atomic<uint64_t> max_hold_ns{0};
+    } debug;
+#endif
+
+    M mutex;
     T data;
 };
 
+// Lock all the given DataMutex, which may have different data and lock types,
+// without deadlock and return their guards in the same order. The locks are
+// acquired by std::lock(...), which uses a try-and-back-off algorithm, so the
+// argument order doesn't matter.
+template<class... Ms>
+std::tuple<typename Ms::MutexGuard...> lock_all(Ms&... mutexes) {
+    static_assert(sizeof...(Ms) > 0, "lock_all needs at least one DataMutex");
+#ifndef NDEBUG
+    // Locking the same DataMutex twice will never return
+    const void* addresses[] = { &mutexes... };
+    for (size_t i = 0 ; i < sizeof...(Ms) ; ++i) {
+        for (size_t j = i + 1 ; j < sizeof...(Ms) ; ++j) {
+            assert(addresses[i] != addresses[j]);
+        }
+    }
+#endif
+
+#ifdef DATA_MUTEX_DEBUG
+    auto start = std::chrono::steady_clock::now();
+#endif
+    if constexpr (sizeof...(Ms) == 1) {
+        (mutexes.lock_mutex(), ...);
+    } else {
+#ifdef CONTENTION_PROFILER
+        uint64_t profile_start = ContentionProfiler::now_ns();
+        std::lock(mutexes.mutex...);
+        uint64_t latency = ContentionProfiler::now_ns() - profile_start;
+        for (size_t i = 0 ; i < sizeof...(Ms) ; ++i) {
+            ContentionProfiler::record(ProfileMetric::DataMutexAcquireLatency,
+                                       latency);
+        }
+#else
+        std::lock(mutexes.mutex...);
+#endif
+#ifdef EXECUTION_TRACER
+        (EXECUTION_TRACE(LockAcquire, &mutexes), ...);
+#endif
+    }
+#ifdef DATA_MUTEX_DEBUG
+    (mutexes.on_acquire(start), ...);
+    const LockOrderRecorder::Id ids[] = { mutexes.debug.id... };
+    LockOrderRecorder::get().on_acquire(ids, sizeof...(Ms));
+#endif
+
+    return std::tuple<typename Ms::MutexGuard...>(
+        typename Ms::MutexGuard(&mutexes, std::adopt_lock)...);
+}
+
 #endif // DataMutex_h
\ No newline at end of file
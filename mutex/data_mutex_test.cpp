@@ -1,9 +1,11 @@
 #include "data_mutex.h"
+#include "spinlock_mutex.h"
 
 #include <cassert>
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <string>
 
 const std::chrono::duration<int, std::milli> TASK_DELAY(10);
 const int DUMMY_COUNT = 10;
@@ -35,7 +37,9 @@ void task_2() {
     } // Leave critical section
 }
 
-int main() {
+void test_data_mutex_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
     std::thread t1(task_1);
     std::thread t2(task_2);
 
@@ -47,6 +51,98 @@ int main() {
         assert(guard.data() == 
                (TASK_1_OFFSET + TASK_2_OFFSET) * DUMMY_COUNT + 60);
     } // Leave critical section
+}
+
+void test_lock_all_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    const int TRANSFERS = 10000;
+    DataMutex<int> account_a(1000);
+    DataMutex<int, SpinlockMutex> account_b(1000);
+    DataMutex<std::string> log(std::string(""));
+
+    // The two threads take the locks in opposite orders. Nested lock() calls
+    // would deadlock here sooner or later.
+    std::thread t1([&] {
+        for (int i = 0 ; i < TRANSFERS ; ++i) {
+            auto [a, b] = lock_all(account_a, account_b);
+            a.data() -= 1;
+            b.data() += 1;
+        }
+    });
+    std::thread t2([&] {
+        for (int i = 0 ; i < TRANSFERS ; ++i) {
+            auto [b, a, l] = lock_all(account_b, account_a, log);
+            b.data() -= 1;
+            a.data() += 1;
+            if (i % (TRANSFERS / 4) == 0) {
+                l.data() += "*";
+            }
+        }
+    });
+
+    t1.join();
+    t2.join();
+
+    auto [a, b, l] = lock_all(account_a, account_b, log);
+    std::cout << "a: " << a.data() << ", b: " << b.data()
+              << ", log: " << l.data() << std::endl;
+    assert(a.data() == 1000 && b.data() == 1000);
+    assert(l.data() == "****");
+}
+
+#ifdef DATA_MUTEX_DEBUG
+void test_debug_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    LockOrderRecorder::get().reset();
 
+    DataMutex<int> first(0);
+    DataMutex<int> second(0);
+
+    {
+        auto g1 = first.lock();
+        auto g2 = second.lock(); // first -> second
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(LockOrderRecorder::get().lock_order_violations().empty());
+
+    {
+        auto [g2, g1] = lock_all(second, first); // No order
+    }
+    assert(LockOrderRecorder::get().lock_order_violations().empty());
+
+    std::thread([&] {
+        auto g2 = second.lock();
+        auto g1 = first.lock(); // second -> first: Potential deadlock!
+    }).join();
+
+    auto violations = LockOrderRecorder::get().lock_order_violations();
+    for (const auto& [a, b]: violations) {
+        std::cout << "DataMutex " << a << " and " << b
+                  << " are acquired in both orders" << std::endl;
+    }
+    assert(violations.size() == 1);
+    assert(*violations.begin() ==
+           LockOrderRecorder::Edge(first.stats().id, second.stats().id));
+
+    auto stats = first.stats();
+    std::cout << "DataMutex " << stats.id << ": "
+              << stats.acquisitions << " acquisitions, wait "
+              << stats.total_wait.count() << "ns (max "
+              << stats.max_wait.count() << "ns), hold "
+              << stats.total_hold.count() << "ns (max "
+              << stats.max_hold.count() << "ns)" << std::endl;
+    assert(stats.acquisitions == 3);
+    assert(stats.max_hold >= std::chrono::milliseconds(1));
+}
+#endif
+
+int main() {
+    test_data_mutex_example();
+    test_lock_all_example();
+#ifdef DATA_MUTEX_DEBUG
+    test_debug_example();
+#endif
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,144 @@
+#ifndef FutexMutex_h
+#define FutexMutex_h
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+// A hook between the atomic operations for the stress tests to perturb the
+// thread schedule. See stress/stress.h.
+#ifndef SCHEDULE_POINT
+#define SCHEDULE_POINT()
+#endif
+
+// FutexMutex
+//     A mutex for short critical sections that spins for a while, then parks
+//     the thread in the kernel. SpinlockMutex spins forever, so its waiters
+//     burn whole time slices when the holder is preempted. std::mutex parks
+//     too eagerly for a critical section of ~100ns. This one sits between
+//     them.
+//
+//     The lock word has three states [1]:
+//     - 0: unlocked
+//     - 1: locked, and no thread is parked
+//     - 2: locked, and some threads may be parked
+//     An uncontended lock() and unlock() are one atomic operation each.
+//     unlock() only makes the FUTEX_WAKE syscall if the word was 2, i.e.,
+//     when there may be sleepers.
+//
+//     Before parking, lock() spins up to a limit learned from the recent
+//     acquisitions, as glibc's adaptive mutex does. The spins a waiter needed
+//     to get the lock are the rest of the holder's hold time, so the limit
+//     follows twice their moving average: short hold times keep the waiters
+//     spinning, and a waiter that has spun in vain, e.g., because the holder
+//     has been preempted, halves the limit, so the waiters soon stop spinning
+//     on an oversubscribed host.
+//
+//     It's Linux-only, and plugs into DataMutex as DataMutex<T, FutexMutex>.
+//
+// Usage:
+//     DataMutex<Book, FutexMutex> book(Book {});
+//     book.lock().data().add(order); // Spins briefly or parks if contended
+//
+// [1] Ulrich Drepper, Futexes are tricky, 2011
+class FutexMutex final {
+public:
+    FutexMutex(): word(UNLOCKED), average_spins(MIN_SPINS) {}
+
+    ~FutexMutex() = default;
+
+    void lock() {
+        uint32_t expected = UNLOCKED;
+        if (word.compare_exchange_strong(expected, LOCKED,
+                                         std::memory_order_acquire,
+                                         std::memory_order_relaxed)) {
+            return;
+        }
+        if (spin()) {
+            return;
+        }
+        // Mark the lock contended before parking, so the holder wakes us up.
+        // Whoever gets the lock here keeps it contended, since other threads
+        // may still be parked.
+        SCHEDULE_POINT();
+        while (word.exchange(CONTENDED, std::memory_order_acquire) != UNLOCKED) {
+            // Returns right away if the word isn't CONTENDED anymore
+            syscall(SYS_futex, &word, FUTEX_WAIT_PRIVATE, CONTENDED, nullptr,
+                    nullptr, 0);
+        }
+    }
+
+    bool try_lock() {
+        uint32_t expected = UNLOCKED;
+        return word.compare_exchange_strong(expected, LOCKED,
+                                            std::memory_order_acquire,
+                                            std::memory_order_relaxed);
+    }
+
+    void unlock() {
+        SCHEDULE_POINT();
+        if (word.exchange(UNLOCKED, std::memory_order_release) == CONTENDED) {
+            syscall(SYS_futex, &word, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr,
+                    0);
+        }
+    }
+
+    // Disallowed operations
+    FutexMutex(const FutexMutex& other) = delete;
+    FutexMutex(FutexMutex&& other) = delete;
+    FutexMutex& operator=(const FutexMutex& other) = delete;
+    FutexMutex& operator=(FutexMutex&& other) = delete;
+
+private:
+    static constexpr uint32_t UNLOCKED = 0;
+    static constexpr uint32_t LOCKED = 1;
+    static constexpr uint32_t CONTENDED = 2;
+    static constexpr uint32_t MIN_SPINS = 8;
+    static constexpr uint32_t MAX_SPINS = 1000;
+
+    static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    // Spin up to the learned limit. Returns true if the lock is taken.
+    bool spin() {
+        uint32_t average = average_spins.load(std::memory_order_relaxed);
+        uint32_t limit = std::min(MAX_SPINS, 2 * average);
+        for (uint32_t spins = 1 ; spins <= limit ; ++spins) {
+            cpu_relax();
+            // Only try the CAS when it can succeed, so the waiters don't
+            // keep stealing the cache line from the holder
+            if (word.load(std::memory_order_relaxed) != UNLOCKED) {
+                continue;
+            }
+            uint32_t expected = UNLOCKED;
+            if (word.compare_exchange_weak(expected, LOCKED,
+                                           std::memory_order_acquire,
+                                           std::memory_order_relaxed)) {
+                // The average moves an eighth of the way to spins. Racing
+                // updates lose some samples, which is fine for a hint.
+                int32_t delta = (static_cast<int32_t>(spins)
+                                 - static_cast<int32_t>(average)) / 8;
+                average_spins.store(std::max<int32_t>(MIN_SPINS, average + delta),
+                                    std::memory_order_relaxed);
+                return true;
+            }
+        }
+        average_spins.store(std::max(MIN_SPINS, average / 2),
+                            std::memory_order_relaxed);
+        return false;
+    }
+
+    std::atomic<uint32_t> word;
+    std::atomic<uint32_t> average_spins; // A hint. Relaxed accesses only.
+};
+
+#endif // FutexMutex_h
\ No newline at end of file
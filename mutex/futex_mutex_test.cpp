@@ -0,0 +1,70 @@
+#include "data_mutex.h"
+#include "futex_mutex.h"
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+const size_t THREADS = 8;
+const uint64_t INCREMENTS = 100000;
+
+void test_futex_mutex_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    FutexMutex mutex;
+    assert(mutex.try_lock());
+    assert(!mutex.try_lock());
+    mutex.unlock();
+
+    // More threads than CPUs, so the holders get preempted and the waiters
+    // park
+    uint64_t counter = 0; // Protected by mutex
+    std::vector<std::thread> threads;
+    for (size_t t = 0 ; t < THREADS ; ++t) {
+        threads.emplace_back([&] {
+            for (uint64_t i = 0 ; i < INCREMENTS ; ++i) {
+                mutex.lock(); // Enter critical section
+                ++counter;
+                mutex.unlock(); // Leave critical section
+            }
+        });
+    }
+    for (std::thread& t: threads) {
+        t.join();
+    }
+    std::cout << "Counter: " << counter << std::endl;
+    assert(counter == THREADS * INCREMENTS);
+}
+
+void test_futex_mutex_sleeping_holder() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    // The waiters give up spinning and park while the holder sleeps, and
+    // every unlock() wakes one of them up
+    DataMutex<std::vector<size_t>, FutexMutex> order(std::vector<size_t> {});
+    std::vector<std::thread> threads;
+    {
+        auto guard = order.lock(); // Enter critical section
+        for (size_t t = 0 ; t < THREADS ; ++t) {
+            threads.emplace_back([&order, t] {
+                auto guard = order.lock(); // Enter critical section
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                guard.data().push_back(t);
+            }); // Leave critical section
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    } // Leave critical section
+    for (std::thread& t: threads) {
+        t.join();
+    }
+    std::cout << "Threads done: " << order.lock().data().size() << std::endl;
+    assert(order.lock().data().size() == THREADS);
+}
+
+int main() {
+    test_futex_mutex_example();
+    test_futex_mutex_sleeping_holder();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,130 @@
+#ifndef SeqLock_h
+#define SeqLock_h
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <type_traits>
+
+// A hook between the atomic operations for the stress tests to perturb the
+// thread schedule. See stress/stress.h.
+#ifndef SCHEDULE_POINT
+#define SCHEDULE_POINT()
+#endif
+
+// SeqLock
+//     A cell holding the latest value of T, for one writer and many readers,
+//     e.g., the latest quote of a symbol. The writer never waits, and the
+//     readers never write to the shared memory, so they don't bounce its
+//     cache line between them as a mutex or even a reader-writer lock does.
+//
+//     The cell has a sequence number that the writer makes odd before
+//     changing the value and even again after it. A reader copies the value
+//     out between two loads of the sequence number, and retries if the number
+//     was odd or has changed, since the copy may be torn then [1].
+//
+//     The value is kept in an array of atomic words accessed with relaxed
+//     ordering, so the racing copies are still well-defined C++. That needs T
+//     to be trivially copyable, but not default constructible: load() copies
+//     the bytes into raw storage. try_load(value) takes a T to copy into.
+//
+// Usage:
+//     SeqLock<Quote> latest;
+//     latest.store(quote); // Writer thread
+//     Quote q = latest.load(); // Any reader thread
+//
+// [1] Hans-J. Boehm, Can seqlocks get along with programming language memory
+//     models?, 2012
+template<class T>
+class SeqLock final {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "SeqLock needs a trivially copyable type");
+
+public:
+    explicit SeqLock(const T& initial = T()): sequence(0) {
+        write_words(initial);
+    }
+
+    ~SeqLock() = default;
+
+    // Runs on the writer thread only
+    void store(const T& value) {
+        uint64_t s = sequence.load(std::memory_order_relaxed);
+        sequence.store(s + 1, std::memory_order_relaxed);
+        // Keep the word stores below the odd sequence number
+        std::atomic_thread_fence(std::memory_order_release);
+        SCHEDULE_POINT();
+        write_words(value);
+        sequence.store(s + 2, std::memory_order_release);
+    }
+
+    // Runs on any thread. Spins, then yields, while the writer is in the
+    // middle of a store.
+    T load() const {
+        Words words;
+        for (size_t spins = 0 ; !try_load_words(words) ; ++spins) {
+            if (spins >= SPINS_BEFORE_YIELD) {
+                std::this_thread::yield();
+            }
+        }
+        alignas(T) unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, words, sizeof(T));
+        return *std::launder(reinterpret_cast<const T*>(bytes));
+    }
+
+    // Runs on any thread. Returns false instead of retrying if the writer is
+    // in the middle of a store.
+    bool try_load(T& value) const {
+        Words words;
+        if (!try_load_words(words)) {
+            return false;
+        }
+        std::memcpy(&value, words, sizeof(T));
+        return true;
+    }
+
+    // The number of stores so far. Runs on any thread.
+    uint64_t version() const {
+        return sequence.load(std::memory_order_acquire) / 2;
+    }
+
+    // Disallowed operations
+    SeqLock(const SeqLock& other) = delete;
+    SeqLock(SeqLock&& other) = delete;
+    SeqLock& operator=(const SeqLock& other) = delete;
+    SeqLock& operator=(SeqLock&& other) = delete;
+
+private:
+    static const size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    static const size_t SPINS_BEFORE_YIELD = 64;
+    typedef uint64_t Words[WORDS];
+
+    bool try_load_words(Words& words) const {
+        uint64_t before = sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            return false;
+        }
+        SCHEDULE_POINT();
+        for (size_t i = 0 ; i < WORDS ; ++i) {
+            words[i] = storage[i].load(std::memory_order_relaxed);
+        }
+        // Keep the word loads above the second load of the sequence number
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return sequence.load(std::memory_order_relaxed) == before;
+    }
+
+    void write_words(const T& value) {
+        Words words = {};
+        std::memcpy(words, &value, sizeof(T));
+        for (size_t i = 0 ; i < WORDS ; ++i) {
+            storage[i].store(words[i], std::memory_order_relaxed);
+        }
+    }
+
+    alignas(64) std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> storage[WORDS];
+};
+
+#endif // SeqLock_h
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "seqlock.h"
+
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+const uint64_t NUM_OF_UPDATES = 200000;
+const size_t READERS = 3;
+
+// The fields of a consistent quote always satisfy ask == bid + 1 and
+// volume == 10 * id
+struct Quote {
+    uint64_t id;
+    double bid;
+    double ask;
+    uint64_t volume;
+    char symbol[5];
+};
+
+Quote make_quote(uint64_t id) {
+    return Quote { id, id * 0.25, id * 0.25 + 1, 10 * id, "ABCD" };
+}
+
+void test_seqlock_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    SeqLock<Quote> latest(make_quote(0));
+    assert(latest.version() == 0);
+    assert(latest.load().id == 0);
+
+    std::atomic<bool> done(false);
+    std::vector<std::thread> readers;
+    std::vector<uint64_t> loads(READERS, 0);
+    for (size_t r = 0 ; r < READERS ; ++r) {
+        readers.emplace_back([&, r] {
+            uint64_t last = 0;
+            while (!done) {
+                Quote q = latest.load();
+                // Never torn, and never older than the one seen before
+                assert(q.ask == q.bid + 1);
+                assert(q.volume == 10 * q.id);
+                assert(q.bid == q.id * 0.25);
+                assert(q.id >= last);
+                last = q.id;
+                ++loads[r];
+            }
+        });
+    }
+
+    // The writer never waits for the readers
+    for (uint64_t id = 1 ; id <= NUM_OF_UPDATES ; ++id) {
+        latest.store(make_quote(id));
+    }
+    done = true;
+    for (std::thread& t: readers) {
+        t.join();
+    }
+
+    assert(latest.version() == NUM_OF_UPDATES);
+    Quote q;
+    assert(latest.try_load(q) && q.id == NUM_OF_UPDATES);
+    for (size_t r = 0 ; r < READERS ; ++r) {
+        std::cout << "reader " << r << " loaded " << loads[r] << " quotes"
+                  << std::endl;
+    }
+}
+
+// Trivially copyable, but not default constructible
+struct Point {
+    Point(int x, int y): x(x), y(y) {}
+
+    int x;
+    int y;
+};
+
+void test_no_default_constructor_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    SeqLock<Point> latest(Point(1, 2));
+    latest.store(Point(3, 4));
+    Point p = latest.load();
+    std::cout << "Loaded (" << p.x << ", " << p.y << ")" << std::endl;
+    assert(p.x == 3 && p.y == 4);
+    assert(latest.try_load(p) && p.x == 3 && p.y == 4);
+}
+
+int main() {
+    test_seqlock_example();
+    test_no_default_constructor_example();
+    return 0;
+}
\ No newline at end of file
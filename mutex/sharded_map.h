@@ -0,0 +1,263 @@
+#ifndef ShardedMap_h
+#define ShardedMap_h
+
+#include "data_mutex.h"
+
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// ShardedMap
+//     A concurrent hash map for the places where a
+//     DataMutex<std::unordered_map<K, V>> makes one lock the bottleneck of
+//     every lookup. The keys are spread over a fixed number of shards, each a
+//     DataMutex of its own table, so threads working on different shards
+//     don't wait for each other. The shards are aligned to the cache lines,
+//     so their locks don't share a line either.
+//
+//     Each table uses open addressing with linear probing over flat arrays: a
+//     byte of tag per slot, holding 7 bits of the hash of its key, and the
+//     key-value pairs. A lookup scans the tags, which are contiguous, and
+//     only compares the keys whose tags match. The nodes and pointers of
+//     std::unordered_map are gone.
+//
+//     Every operation holds the guard of one shard for its own duration
+//     only. A table grows by itself when it gets too full, under its own
+//     lock, so the other shards stay available. for_each(...) visits the
+//     shards one by one, so it doesn't stop the world either, but it's not a
+//     snapshot: the entries of the shards visited earlier may have changed by
+//     the end.
+//
+//     K and V must be default-constructible. The hash of K is mixed before
+//     use, so std::hash of an integer, the identity, is fine.
+//
+// Usage:
+//     ShardedMap<std::string, uint64_t> counts;
+//     counts.insert_or_assign("apple", 1);
+//     counts.update("apple", [](uint64_t& n) { ++n; }); // Under the shard lock
+//     std::optional<uint64_t> n = counts.find("apple"); // A copy of 2
+//     counts.for_each([](const std::string& k, const uint64_t& n) { ... });
+template<class K, class V, class Hash = std::hash<K>, class M = std::mutex>
+class ShardedMap final {
+public:
+    // shards is rounded up to a power of two
+    explicit ShardedMap(size_t shards = 64): count(1) {
+        while (count < shards) {
+            count <<= 1;
+        }
+        this->shards.reset(new Shard[count]);
+    }
+
+    ~ShardedMap() = default;
+
+    // Runs on any thread. A copy of the value of key.
+    std::optional<V> find(const K& key) const {
+        uint64_t h = mix(key);
+        auto guard = shard(h).lock(); // Enter critical section
+        const Table& table = guard.data();
+        size_t index = table.find(key, h);
+        if (index == Table::NONE) {
+            return std::nullopt;
+        }
+        return table.entries[index].second;
+    } // Leave critical section
+
+    // Runs on any thread. Returns true if key was inserted, false if assigned.
+    template<class T>
+    bool insert_or_assign(const K& key, T&& value) {
+        uint64_t h = mix(key);
+        auto guard = shard(h).lock(); // Enter critical section
+        Table& table = guard.data();
+        auto [index, inserted] = table.emplace(key, h);
+        table.entries[index].second = std::forward<T>(value);
+        return inserted;
+    } // Leave critical section
+
+    // Runs on any thread. Call f(V&) on the value of key under the shard
+    // lock, on a V() inserted first if key isn't there. Returns true if key
+    // was there. Keep f short: the whole shard waits for it.
+    template<class F>
+    bool update(const K& key, F&& f) {
+        uint64_t h = mix(key);
+        auto guard = shard(h).lock(); // Enter critical section
+        Table& table = guard.data();
+        auto [index, inserted] = table.emplace(key, h);
+        f(table.entries[index].second);
+        return !inserted;
+    } // Leave critical section
+
+    // Runs on any thread. Returns false if key isn't there.
+    bool erase(const K& key) {
+        uint64_t h = mix(key);
+        auto guard = shard(h).lock(); // Enter critical section
+        return guard.data().erase(key, h);
+    } // Leave critical section
+
+    // Runs on any thread. Call f(const K&, const V&) on every entry, holding
+    // one shard lock at a time. f must not access this map.
+    template<class F>
+    void for_each(F&& f) const {
+        for (size_t i = 0 ; i < count ; ++i) {
+            auto guard = shards[i].table.lock(); // Enter critical section
+            const Table& table = guard.data();
+            for (size_t j = 0 ; j < table.tags.size() ; ++j) {
+                if (table.tags[j] & Table::FULL) {
+                    f(table.entries[j].first, table.entries[j].second);
+                }
+            }
+        } // Leave critical section
+    }
+
+    // Runs on any thread. Counted shard by shard, so it's exact only if no
+    // one else is changing the map.
+    size_t size() const {
+        size_t n = 0;
+        for (size_t i = 0 ; i < count ; ++i) {
+            n += shards[i].table.lock().data().used;
+        }
+        return n;
+    }
+
+    size_t shard_count() const {
+        return count;
+    }
+
+    // Disallowed operations
+    ShardedMap(const ShardedMap& other) = delete;
+    ShardedMap(ShardedMap&& other) = delete;
+    ShardedMap& operator=(const ShardedMap& other) = delete;
+    ShardedMap& operator=(ShardedMap&& other) = delete;
+
+private:
+    // An open addressing table with linear probing. Not thread-safe: it's
+    // always accessed through the DataMutex of its shard.
+    struct Table {
+        static constexpr uint8_t EMPTY = 0;
+        static constexpr uint8_t DELETED = 1;
+        static constexpr uint8_t FULL = 0x80; // | 7 bits of the hash
+        static constexpr size_t NONE = SIZE_MAX;
+        static constexpr size_t MIN_CAPACITY = 16;
+
+        std::vector<uint8_t> tags;
+        std::vector<std::pair<K, V>> entries;
+        size_t used = 0; // FULL slots
+        size_t deleted = 0; // DELETED slots
+
+        static uint8_t tag(uint64_t h) {
+            return FULL | (h & 0x7f);
+        }
+
+        // The low bits pick the shard, so the slot comes from the high ones
+        size_t home(uint64_t h) const {
+            return (h >> 32) & (tags.size() - 1);
+        }
+
+        size_t find(const K& key, uint64_t h) const {
+            if (tags.empty()) {
+                return NONE;
+            }
+            size_t mask = tags.size() - 1;
+            uint8_t t = tag(h);
+            for (size_t i = home(h) ; tags[i] != EMPTY ; i = (i + 1) & mask) {
+                if (tags[i] == t && entries[i].first == key) {
+                    return i;
+                }
+            }
+            return NONE;
+        }
+
+        // Returns the slot of key, and whether it has just been inserted with
+        // a V()
+        std::pair<size_t, bool> emplace(const K& key, uint64_t h) {
+            size_t index = find(key, h);
+            if (index != NONE) {
+                return { index, false };
+            }
+            // Keep at least a quarter of the slots EMPTY, so the probes stay
+            // short and always end
+            if ((used + deleted + 1) * 4 > tags.size() * 3) {
+                rehash();
+            }
+            size_t mask = tags.size() - 1;
+            index = home(h);
+            while (tags[index] & FULL) {
+                index = (index + 1) & mask;
+            }
+            if (tags[index] == DELETED) {
+                --deleted;
+            }
+            tags[index] = tag(h);
+            entries[index].first = key;
+            ++used;
+            return { index, true };
+        }
+
+        bool erase(const K& key, uint64_t h) {
+            size_t index = find(key, h);
+            if (index == NONE) {
+                return false;
+            }
+            // A tombstone, so the probes of the keys after it don't stop here
+            tags[index] = DELETED;
+            entries[index] = std::pair<K, V>();
+            --used;
+            ++deleted;
+            return true;
+        }
+
+        // Rebuild the table with the tombstones dropped, doubling it while
+        // it'd be more than half full
+        void rehash() {
+            size_t capacity = std::max(MIN_CAPACITY, tags.size());
+            while ((used + 1) * 2 > capacity) {
+                capacity *= 2;
+            }
+            std::vector<uint8_t> old_tags(capacity, EMPTY);
+            std::vector<std::pair<K, V>> old_entries(capacity);
+            old_tags.swap(tags);
+            old_entries.swap(entries);
+            deleted = 0;
+            size_t mask = capacity - 1;
+            for (size_t i = 0 ; i < old_tags.size() ; ++i) {
+                if (!(old_tags[i] & FULL)) {
+                    continue;
+                }
+                // The tag keeps 7 bits of the hash only, so hash again
+                uint64_t h = mix(old_entries[i].first);
+                size_t index = home(h);
+                while (tags[index] != EMPTY) {
+                    index = (index + 1) & mask;
+                }
+                tags[index] = old_tags[i];
+                entries[index] = std::move(old_entries[i]);
+            }
+        }
+    };
+
+    struct alignas(64) Shard {
+        mutable DataMutex<Table, M> table { Table() };
+    };
+
+    // Spread the bits of the hash over the whole word [1]
+    //
+    // [1] https://probablydance.com/2018/06/16/fibonacci-hashing-the-optimization-that-the-world-forgot-or-a-better-alternative-to-integer-modulo/
+    static uint64_t mix(const K& key) {
+        uint64_t h = Hash()(key) * 0x9e3779b97f4a7c15ull;
+        return h ^ (h >> 29);
+    }
+
+    DataMutex<Table, M>& shard(uint64_t h) const {
+        // Bits 7 and up, the tag takes the lowest 7
+        return shards[(h >> 7) & (count - 1)].table;
+    }
+
+    size_t count;
+    std::unique_ptr<Shard[]> shards;
+};
+
+#endif // ShardedMap_h
\ No newline at end of file
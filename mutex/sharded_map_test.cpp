@@ -0,0 +1,94 @@
+#include "sharded_map.h"
+#include "spinlock_mutex.h"
+
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+const size_t THREADS = 4;
+const uint64_t KEYS = 20000;
+
+void test_sharded_map_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    ShardedMap<std::string, uint64_t> counts(6);
+    assert(counts.shard_count() == 8);
+
+    assert(counts.insert_or_assign("apple", 1));
+    assert(!counts.insert_or_assign("apple", 2));
+    assert(counts.find("apple") == 2);
+    assert(!counts.find("banana"));
+
+    // update(...) inserts a V() for a new key
+    assert(counts.update("apple", [](uint64_t& n) { ++n; }));
+    assert(!counts.update("banana", [](uint64_t& n) { n += 5; }));
+    assert(counts.find("apple") == 3);
+    assert(counts.find("banana") == 5);
+    assert(counts.size() == 2);
+
+    assert(counts.erase("apple"));
+    assert(!counts.erase("apple"));
+    assert(!counts.find("apple"));
+
+    counts.for_each([](const std::string& key, const uint64_t& n) {
+        std::cout << key << ": " << n << std::endl;
+    });
+}
+
+void test_sharded_map_growth() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    // Few shards, so each table grows many times. Erasing every other key
+    // leaves tombstones the probes have to walk past.
+    ShardedMap<uint64_t, uint64_t> map(2);
+    for (uint64_t k = 0 ; k < KEYS ; ++k) {
+        map.insert_or_assign(k, k * k);
+    }
+    for (uint64_t k = 0 ; k < KEYS ; k += 2) {
+        assert(map.erase(k));
+    }
+    for (uint64_t k = 0 ; k < KEYS ; ++k) {
+        std::optional<uint64_t> v = map.find(k);
+        assert(k % 2 ? v == k * k : !v);
+    }
+    // Fill the tombstones again
+    for (uint64_t k = 0 ; k < KEYS ; k += 2) {
+        assert(map.insert_or_assign(k, k));
+    }
+    std::cout << "Size: " << map.size() << std::endl;
+    assert(map.size() == KEYS);
+}
+
+void test_sharded_map_threads() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    // Every thread counts every key, so each count ends at THREADS
+    ShardedMap<uint64_t, uint64_t, std::hash<uint64_t>, SpinlockMutex> counts;
+    std::vector<std::thread> threads;
+    for (size_t t = 0 ; t < THREADS ; ++t) {
+        threads.emplace_back([&counts, t] {
+            for (uint64_t i = 0 ; i < KEYS ; ++i) {
+                counts.update((i + t * 997) % KEYS, [](uint64_t& n) { ++n; });
+            }
+        });
+    }
+    for (std::thread& t: threads) {
+        t.join();
+    }
+    uint64_t keys = 0;
+    counts.for_each([&keys](const uint64_t& key, const uint64_t& n) {
+        assert(n == THREADS);
+        ++keys;
+    });
+    std::cout << "Keys: " << keys << std::endl;
+    assert(keys == KEYS);
+}
+
+int main() {
+    test_sharded_map_example();
+    test_sharded_map_growth();
+    test_sharded_map_threads();
+    return 0;
+}
\ No newline at end of file
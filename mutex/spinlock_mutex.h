@@ -3,12 +3,31 @@
 
 #include <atomic>
 
+#ifdef CONTENTION_PROFILER
+#include "../profiler/contention_profiler.h"
+#endif
+
 class SpinlockMutex {
 public:
     SpinlockMutex(): flag(ATOMIC_FLAG_INIT) {}
 
     void lock() {
+#ifdef CONTENTION_PROFILER
+        uint64_t start = ContentionProfiler::now_ns();
+        uint64_t spins = 0;
+        while(flag.test_and_set(std::memory_order_acquire)) {
+            ++spins;
+        }
+        ContentionProfiler::record(ProfileMetric::SpinlockAcquireLatency,
+                                   ContentionProfiler::now_ns() - start);
+        ContentionProfiler::record(ProfileMetric::SpinlockSpins, spins);
+#else
         while(flag.test_and_set(std::memory_order_acquire));
+#endif
+    }
+
+    bool try_lock() {
+        return !flag.test_and_set(std::memory_order_acquire);
     }
 
     void unlock() {
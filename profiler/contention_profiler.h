@@ -0,0 +1,300 @@
+#ifndef ContentionProfiler_h
+#define ContentionProfiler_h
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ContentionProfiler
+//     An opt-in instrumentation layer showing where the threads spend time
+//     waiting. It's compiled into SpinlockMutex, DataMutex, TaskQueue and
+//     SimpleSerialTaskQueue only when CONTENTION_PROFILER is defined before
+//     including them, e.g., by -DCONTENTION_PROFILER. Otherwise those classes
+//     don't include this file at all and nothing is recorded, so there is no
+//     overhead.
+//
+//     Every metric is a histogram with power-of-two buckets. Each thread
+//     records into its own thread-local histograms, which are only read by
+//     snapshot() and merged into the global ones when the thread exits, so
+//     recording never touches a cache line shared with other threads.
+//
+// Usage:
+//     // Build with -DCONTENTION_PROFILER
+//     TaskQueue q(4);
+//     ... // Dispatch tasks
+//     ProfileSnapshot s = ContentionProfiler::snapshot();
+//     std::cout << s.to_text();
+//     std::ofstream("profile.json") << s.to_json();
+enum class ProfileMetric : size_t {
+    SpinlockSpins,              // iterations spun before acquiring
+    SpinlockAcquireLatency,     // ns from lock() call to acquiring
+    DataMutexAcquireLatency,    // ns from lock()/lock_all() call to acquiring
+    TaskQueueDepth,             // tasks queued, including the new one
+    TaskQueueWaitToRun,         // ns from dispatch() to the task starting
+    TaskQueueRunTime,           // ns the task runs
+    SerialTaskQueueDepth,       // same as above, for SimpleSerialTaskQueue
+    SerialTaskQueueWaitToRun,
+    SerialTaskQueueRunTime,
+    Count
+};
+
+// A histogram of uint64_t values. Bucket 0 counts the zeros and bucket i
+// counts the values in [2^(i-1), 2^i).
+struct ProfileHistogram {
+    static constexpr size_t BUCKETS = 65;
+
+    static size_t bucket_of(uint64_t value) {
+        return value == 0 ? 0 : 64 - __builtin_clzll(value);
+    }
+
+    // The largest value in the bucket
+    static uint64_t bucket_bound(size_t bucket) {
+        assert(bucket < BUCKETS);
+        return bucket == 0 ? 0 : bucket == 64 ? UINT64_MAX
+                                              : (uint64_t(1) << bucket) - 1;
+    }
+
+    // The upper bound of the bucket where the p-th percentile falls
+    uint64_t percentile(double p) const {
+        if (count == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * (count - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0 ; i < BUCKETS ; ++i) {
+            seen += buckets[i];
+            if (seen >= rank) {
+                return std::min(bucket_bound(i), max);
+            }
+        }
+        return max;
+    }
+
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    std::array<uint64_t, BUCKETS> buckets {};
+};
+
+struct ProfileSnapshot {
+    static constexpr size_t METRICS = static_cast<size_t>(ProfileMetric::Count);
+
+    static const char* name(ProfileMetric metric) {
+        static const char* const NAMES[METRICS] = {
+            "spinlock_spins",
+            "spinlock_acquire_latency_ns",
+            "data_mutex_acquire_latency_ns",
+            "task_queue_depth",
+            "task_queue_wait_to_run_ns",
+            "task_queue_run_time_ns",
+            "serial_task_queue_depth",
+            "serial_task_queue_wait_to_run_ns",
+            "serial_task_queue_run_time_ns",
+        };
+        return NAMES[static_cast<size_t>(metric)];
+    }
+
+    const ProfileHistogram& operator[](ProfileMetric metric) const {
+        return histograms[static_cast<size_t>(metric)];
+    }
+
+    // One line per recorded metric
+    std::string to_text() const {
+        std::ostringstream out;
+        for (size_t i = 0 ; i < METRICS ; ++i) {
+            const ProfileHistogram& h = histograms[i];
+            if (h.count == 0) {
+                continue;
+            }
+            out << name(static_cast<ProfileMetric>(i))
+                << ": count=" << h.count
+                << " mean=" << h.sum / h.count
+                << " p50<=" << h.percentile(50)
+                << " p90<=" << h.percentile(90)
+                << " p99<=" << h.percentile(99)
+                << " max=" << h.max << "\n";
+        }
+        return out.str();
+    }
+
+    // All the metrics, with the non-empty buckets as [upper bound, count]
+    std::string to_json() const {
+        std::ostringstream out;
+        out << "{";
+        for (size_t i = 0 ; i < METRICS ; ++i) {
+            const ProfileHistogram& h = histograms[i];
+            out << (i ? "," : "") << "\"" << name(static_cast<ProfileMetric>(i))
+                << "\":{\"count\":" << h.count
+                << ",\"sum\":" << h.sum
+                << ",\"max\":" << h.max
+                << ",\"p50\":" << h.percentile(50)
+                << ",\"p90\":" << h.percentile(90)
+                << ",\"p99\":" << h.percentile(99)
+                << ",\"buckets\":[";
+            bool first = true;
+            for (size_t b = 0 ; b < ProfileHistogram::BUCKETS ; ++b) {
+                if (h.buckets[b]) {
+                    out << (first ? "" : ",") << "["
+                        << ProfileHistogram::bucket_bound(b) << ","
+                        << h.buckets[b] << "]";
+                    first = false;
+                }
+            }
+            out << "]}";
+        }
+        out << "}";
+        return out.str();
+    }
+
+    std::array<ProfileHistogram, METRICS> histograms {};
+};
+
+class ContentionProfiler final {
+public:
+    static uint64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Runs on any thread. Only touches the thread's own histograms.
+    static void record(ProfileMetric metric, uint64_t value) {
+        thread_recorder().record(metric, value);
+    }
+
+    // Wrap a task to record how long it waits in the queue, from now to the
+    // time it's called, and how long it runs
+    template<class F>
+    static auto profile_task(F&& task, ProfileMetric wait_to_run,
+                             ProfileMetric run_time) {
+        return [task = std::forward<F>(task), wait_to_run, run_time,
+                dispatched_at = now_ns()]() mutable {
+            uint64_t start = now_ns();
+            record(wait_to_run, start - dispatched_at);
+            task();
+            record(run_time, now_ns() - start);
+        };
+    }
+
+    // The data recorded by all the threads so far
+    static ProfileSnapshot snapshot() {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> guard(r.mutex); // Enter critical section
+        ProfileSnapshot s = r.exited;
+        for (const ThreadRecorder* recorder: r.recorders) {
+            recorder->add_to(s);
+        }
+        return s;
+    } // Leave critical section
+
+    // Drop all the recorded data
+    static void reset() {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> guard(r.mutex); // Enter critical section
+        r.exited = ProfileSnapshot();
+        for (ThreadRecorder* recorder: r.recorders) {
+            recorder->clear();
+        }
+    } // Leave critical section
+
+private:
+    // The histograms of one thread. Only the owner thread writes them, so
+    // the updates are plain relaxed loads and stores rather than RMWs. They
+    // are atomic only so snapshot() can read them from other threads.
+    class ThreadRecorder final {
+    public:
+        ThreadRecorder() {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> guard(r.mutex); // Enter critical section
+            r.recorders.push_back(this);
+        } // Leave critical section
+
+        ~ThreadRecorder() {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> guard(r.mutex); // Enter critical section
+            add_to(r.exited);
+            r.recorders.erase(
+                std::find(r.recorders.begin(), r.recorders.end(), this));
+        } // Leave critical section
+
+        void record(ProfileMetric metric, uint64_t value) {
+            Histogram& h = histograms[static_cast<size_t>(metric)];
+            increase(h.count, 1);
+            increase(h.sum, value);
+            if (value > h.max.load(std::memory_order_relaxed)) {
+                h.max.store(value, std::memory_order_relaxed);
+            }
+            increase(h.buckets[ProfileHistogram::bucket_of(value)], 1);
+        }
+
+        void add_to(ProfileSnapshot& s) const {
+            for (size_t i = 0 ; i < ProfileSnapshot::METRICS ; ++i) {
+                const Histogram& src = histograms[i];
+                ProfileHistogram& dst = s.histograms[i];
+                dst.count += src.count.load(std::memory_order_relaxed);
+                dst.sum += src.sum.load(std::memory_order_relaxed);
+                dst.max = std::max(dst.max,
+                                   src.max.load(std::memory_order_relaxed));
+                for (size_t b = 0 ; b < ProfileHistogram::BUCKETS ; ++b) {
+                    dst.buckets[b] +=
+                        src.buckets[b].load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Racy with record() by design: a concurrent record may be partly
+        // kept. Only used by reset().
+        void clear() {
+            for (Histogram& h: histograms) {
+                h.count.store(0, std::memory_order_relaxed);
+                h.sum.store(0, std::memory_order_relaxed);
+                h.max.store(0, std::memory_order_relaxed);
+                for (std::atomic<uint64_t>& b: h.buckets) {
+                    b.store(0, std::memory_order_relaxed);
+                }
+            }
+        }
+
+    private:
+        struct Histogram {
+            std::atomic<uint64_t> count {0};
+            std::atomic<uint64_t> sum {0};
+            std::atomic<uint64_t> max {0};
+            std::array<std::atomic<uint64_t>, ProfileHistogram::BUCKETS> buckets {};
+        };
+
+        static void increase(std::atomic<uint64_t>& v, uint64_t n) {
+            v.store(v.load(std::memory_order_relaxed) + n,
+                    std::memory_order_relaxed);
+        }
+
+        std::array<Histogram, ProfileSnapshot::METRICS> histograms;
+    };
+
+    struct Registry {
+        std::mutex mutex;
+        std::vector<ThreadRecorder*> recorders; // Protected by mutex
+        ProfileSnapshot exited; // Data of the exited threads. Protected by mutex
+    };
+
+    static Registry& registry() {
+        static Registry r;
+        return r;
+    }
+
+    static ThreadRecorder& thread_recorder() {
+        // Make sure the registry outlives the thread recorders
+        registry();
+        thread_local ThreadRecorder recorder;
+        return recorder;
+    }
+};
+
+#endif // ContentionProfiler_h
\ No newline at end of file
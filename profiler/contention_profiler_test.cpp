@@ -0,0 +1,106 @@
+#include "../mutex/data_mutex.h"
+#include "../mutex/spinlock_mutex.h"
+#include "../task_queue/simple_serial_task_queue.h"
+#include "../task_queue/task_queue.h"
+#include "contention_profiler.h"
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#ifndef CONTENTION_PROFILER
+#error "Build this test with -DCONTENTION_PROFILER"
+#endif
+
+const size_t THREADS = 4;
+const size_t LOOPS = 1000;
+
+void test_mutex_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    ContentionProfiler::reset();
+
+    SpinlockMutex spinlock;
+    DataMutex<int> data(0);
+    DataMutex<int, SpinlockMutex> spin_data(0);
+    int counter = 0; // Protected by spinlock
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0 ; i < THREADS ; ++i) {
+        threads.emplace_back([&] {
+            for (size_t j = 0 ; j < LOOPS ; ++j) {
+                spinlock.lock();
+                ++counter;
+                spinlock.unlock();
+
+                data.lock().data() += 1;
+
+                auto [a, b] = lock_all(data, spin_data);
+                b.data() += a.data() % 2;
+            }
+        });
+    }
+    for (std::thread& t: threads) {
+        t.join();
+    }
+
+    ProfileSnapshot s = ContentionProfiler::snapshot();
+    std::cout << s.to_text();
+    assert(counter == THREADS * LOOPS);
+    // One from spinlock, one from spin_data in lock_all(...)
+    assert(s[ProfileMetric::SpinlockSpins].count >= THREADS * LOOPS);
+    assert(s[ProfileMetric::SpinlockAcquireLatency].count ==
+           s[ProfileMetric::SpinlockSpins].count);
+    // One from data.lock() and two from lock_all(...)
+    assert(s[ProfileMetric::DataMutexAcquireLatency].count ==
+           3 * THREADS * LOOPS);
+}
+
+void test_task_queue_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    ContentionProfiler::reset();
+
+    const size_t TASKS = 100;
+    {
+        TaskQueue q(THREADS);
+        std::vector<std::future<void>> futures;
+        for (size_t i = 0 ; i < TASKS ; ++i) {
+            futures.emplace_back(q.dispatch([] {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }));
+        }
+        for (std::future<void>& f: futures) {
+            f.wait();
+        }
+    } // Workers exit here and their records are merged
+
+    {
+        SimpleSerialTaskQueue q;
+        for (size_t i = 0 ; i < TASKS ; ++i) {
+            q.dispatch([] {
+                std::this_thread::sleep_for(std::chrono::microseconds(10));
+            });
+        }
+        q.wait();
+    }
+
+    ProfileSnapshot s = ContentionProfiler::snapshot();
+    std::cout << s.to_text();
+    std::cout << s.to_json() << std::endl;
+    assert(s[ProfileMetric::TaskQueueDepth].count == TASKS);
+    assert(s[ProfileMetric::TaskQueueWaitToRun].count == TASKS);
+    assert(s[ProfileMetric::TaskQueueRunTime].count == TASKS);
+    assert(s[ProfileMetric::TaskQueueRunTime].percentile(50) >= 100000 / 2);
+    assert(s[ProfileMetric::SerialTaskQueueDepth].count == TASKS);
+    assert(s[ProfileMetric::SerialTaskQueueRunTime].count == TASKS);
+    assert(s[ProfileMetric::SpinlockSpins].count == 0);
+}
+
+int main() {
+    test_mutex_example();
+    test_task_queue_example();
+    return 0;
+}
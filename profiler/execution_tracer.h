@@ -0,0 +1,427 @@
+#ifndef ExecutionTracer_h
+#define ExecutionTracer_h
+
+#include "../ring_buffer/ring_buffer.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// ExecutionTracer
+//     An opt-in flight recorder of what the TaskQueue, SimpleSerialTaskQueue
+//     and DataMutex are doing, on a timeline, for the times the throughput
+//     drops and the histograms of ContentionProfiler don't say why: the tasks
+//     queueing up, the workers parked while there is work, a long task, or a
+//     lock held across a task.
+//
+//     Like ContentionProfiler, it's compiled into those classes only when
+//     EXECUTION_TRACER is defined before including them, e.g., by
+//     -DEXECUTION_TRACER. Otherwise their EXECUTION_TRACE(...) hooks expand
+//     to nothing and this file isn't included at all.
+//
+//     Each thread writes fixed-size records, a timestamp, the queue or mutex
+//     and the event type, into its own SPSCRingBuffer, with no lock and no
+//     RMW. The timestamps are TSC ticks where there is a TSC, which are
+//     cheaper to read than std::chrono::steady_clock. A collector thread
+//     drains the rings every COLLECT_PERIOD and appends the events to a
+//     Chrome trace JSON file, which chrome://tracing and ui.perfetto.dev
+//     open. The events of a full ring are dropped and counted, rather than
+//     blocking the thread.
+//
+//     The collector pairs the events into spans per thread: TaskStart and
+//     TaskEnd into "task", Park and Wake into "parked", LockAcquire and
+//     LockRelease into "lock held". Enqueue and Dequeue are instant events.
+//
+// Usage:
+//     // Build with -DEXECUTION_TRACER
+//     ExecutionTracer::start("trace.json");
+//     TaskQueue q(4);
+//     ... // Dispatch tasks
+//     ExecutionTracer::stop(); // trace.json is complete now
+enum class TraceEventType : uint8_t {
+    Enqueue,        // a task is queued, on the dispatching thread
+    Dequeue,        // a worker takes the task
+    TaskStart,      // the worker starts running it
+    TaskEnd,        // the task is done
+    Park,           // a worker has nothing to do and goes to sleep
+    Wake,           // the worker wakes up
+    LockAcquire,    // a DataMutex is locked
+    LockRelease,    // the DataMutex is unlocked
+};
+
+// One event, as it's stored in the ring
+struct TraceRecord {
+    uint64_t ticks;
+    const void* object; // The queue or the mutex
+    TraceEventType type;
+};
+
+// Runs on any thread. Compiled out when EXECUTION_TRACER isn't defined, even
+// if this file is included, e.g., by a benchmark calling record(...) itself.
+#ifdef EXECUTION_TRACER
+#define EXECUTION_TRACE(type, object) \
+    ExecutionTracer::record(TraceEventType::type, object)
+#endif
+
+class ExecutionTracer final {
+public:
+    // The events a thread can record between two collections
+    static constexpr size_t RING_CAPACITY = 1 << 15;
+    static constexpr std::chrono::milliseconds COLLECT_PERIOD {10};
+
+#if defined(__x86_64__) || defined(__i386__)
+    static uint64_t now_ticks() {
+        return __rdtsc();
+    }
+#else
+    static uint64_t now_ticks() {
+        return now_ns();
+    }
+#endif
+
+    // Runs on any thread. The hot path: a relaxed load, a thread-local
+    // pointer, the clock and a ring write.
+    static void record(TraceEventType type, const void* object) {
+        if (!enabled.load(std::memory_order_relaxed)) {
+            return;
+        }
+        ThreadTrace* trace = current;
+        if (!trace && !(trace = register_thread())) {
+            return;
+        }
+        if (!trace->ring.write(TraceRecord { now_ticks(), object, type })) {
+            trace->dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Start writing the events to a new trace file at path. Returns false if
+    // the file can't be opened or the tracer is running already.
+    static bool start(const std::string& path) {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> control(r.control); // Enter critical section
+        if (r.collector) {
+            return false;
+        }
+        std::ofstream out(path);
+        if (!out) {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> guard(r.mutex); // Enter critical section
+            // Drop the threads exited since the last trace
+            r.threads.erase(std::remove_if(r.threads.begin(), r.threads.end(),
+                [](const std::shared_ptr<ThreadTrace>& trace) {
+                    return trace->exited.load(std::memory_order_acquire);
+                }), r.threads.end());
+            for (const std::shared_ptr<ThreadTrace>& trace: r.threads) {
+                trace->reset();
+            }
+        } // Leave critical section
+        r.collector.reset(new Collector(r, std::move(out)));
+        enabled.store(true, std::memory_order_relaxed);
+        return true;
+    } // Leave critical section
+
+    // Stop recording, collect the events left and complete the trace file.
+    // Returns the number of events dropped since start(...).
+    static uint64_t stop() {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> control(r.control); // Enter critical section
+        if (!r.collector) {
+            return 0;
+        }
+        enabled.store(false, std::memory_order_relaxed);
+        uint64_t dropped = r.collector->finish();
+        r.collector.reset();
+        return dropped;
+    } // Leave critical section
+
+    static bool is_running() {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+private:
+    static uint64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // The spans the collector builds out of the begin and end events
+    enum Span : size_t { TaskSpan, ParkSpan, LockSpan, SPANS };
+
+    // The ring of one thread. The thread writes it and the collector reads
+    // it. The registry and the thread share it, so it outlives the thread
+    // until the collector has drained it.
+    struct ThreadTrace {
+        explicit ThreadTrace(uint32_t tid)
+            : tid(tid)
+            , ring(RING_CAPACITY)
+            , dropped(0)
+            , exited(false) {}
+
+        // Runs on collector thread, or with no collector running
+        void reset() {
+            for (std::unordered_map<const void*, uint64_t>& o: open) {
+                o.clear();
+            }
+            named = false;
+            dropped.store(0, std::memory_order_relaxed);
+        }
+
+        const uint32_t tid;
+        SPSCRingBuffer<TraceRecord> ring;
+        std::atomic<uint64_t> dropped;
+        std::atomic<bool> exited;
+        // Runs on collector thread. The ticks each open span began at.
+        std::array<std::unordered_map<const void*, uint64_t>, SPANS> open;
+        bool named = false;
+    };
+
+    struct Registry;
+
+    // Drains the rings and writes the trace file
+    class Collector final {
+    public:
+        Collector(Registry& r, std::ofstream&& o)
+            : r(r)
+            , out(std::move(o))
+            , tick0(now_ticks())
+            , ns0(now_ns())
+            , ns_per_tick(1.0)
+            , first(true)
+            , stopping(false) {
+            out << std::fixed << std::setprecision(3)
+                << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+            thread = std::thread([this] {
+                run();
+            });
+        }
+
+        // Returns the number of events dropped
+        uint64_t finish() {
+            {
+                std::lock_guard<std::mutex> guard(mutex); // Enter critical section
+                stopping = true;
+            } // Leave critical section
+            cv.notify_one();
+            thread.join();
+
+            // The thread has stopped, so the collector is ours now
+            drain();
+            uint64_t dropped = 0;
+            {
+                std::lock_guard<std::mutex> guard(r.mutex); // Enter critical section
+                for (const std::shared_ptr<ThreadTrace>& trace: r.threads) {
+                    dropped += trace->dropped.load(std::memory_order_relaxed);
+                }
+            } // Leave critical section
+            dropped += exited_dropped;
+            out << "],\"otherData\":{\"dropped_events\":\"" << dropped << "\"}}";
+            out.close();
+            return dropped;
+        }
+
+        // Disallowed operations
+        Collector(const Collector& other) = delete;
+        Collector(Collector&& other) = delete;
+        Collector& operator=(const Collector& other) = delete;
+        Collector& operator=(Collector&& other) = delete;
+
+    private:
+        // Runs on collector thread
+        void run() {
+            std::unique_lock<std::mutex> lock(mutex); // Enter critical section
+            while (!cv.wait_for(lock, COLLECT_PERIOD, [this] {
+                return stopping;
+            })) {
+                lock.unlock(); // Leave critical section
+                drain();
+                lock.lock(); // Enter critical section
+            }
+        } // Leave critical section
+
+        void drain() {
+            std::vector<std::shared_ptr<ThreadTrace>> traces;
+            {
+                std::lock_guard<std::mutex> guard(r.mutex); // Enter critical section
+                traces = r.threads;
+            } // Leave critical section
+
+            calibrate();
+            for (const std::shared_ptr<ThreadTrace>& trace: traces) {
+                // All the writes of an exited thread are in the ring by now
+                bool exited = trace->exited.load(std::memory_order_acquire);
+                for (const TraceRecord& record: trace->ring.read_all()) {
+                    write(*trace, record);
+                }
+                if (exited) {
+                    exited_dropped += trace->dropped.load(std::memory_order_relaxed);
+                    std::lock_guard<std::mutex> guard(r.mutex); // Enter critical section
+                    r.threads.erase(std::find(r.threads.begin(),
+                                              r.threads.end(), trace));
+                } // Leave critical section
+            }
+        }
+
+        // The ticks per ns, measured over the whole trace so far
+        void calibrate() {
+            uint64_t ticks = now_ticks() - tick0;
+            if (ticks) {
+                ns_per_tick = double(now_ns() - ns0) / ticks;
+            }
+        }
+
+        void write(ThreadTrace& trace, const TraceRecord& record) {
+            // Left in the ring by the previous trace
+            if (record.ticks < tick0) {
+                return;
+            }
+            if (!trace.named) {
+                begin_event("thread_name", "M", trace.tid);
+                out << ",\"args\":{\"name\":\"thread " << trace.tid << "\"}}";
+                trace.named = true;
+            }
+            switch (record.type) {
+            case TraceEventType::Enqueue:
+                instant("enqueue", trace, record);
+                break;
+            case TraceEventType::Dequeue:
+                instant("dequeue", trace, record);
+                break;
+            case TraceEventType::TaskStart:
+                trace.open[TaskSpan][record.object] = record.ticks;
+                break;
+            case TraceEventType::TaskEnd:
+                span("task", TaskSpan, trace, record);
+                break;
+            case TraceEventType::Park:
+                trace.open[ParkSpan][record.object] = record.ticks;
+                break;
+            case TraceEventType::Wake:
+                span("parked", ParkSpan, trace, record);
+                break;
+            case TraceEventType::LockAcquire:
+                trace.open[LockSpan][record.object] = record.ticks;
+                break;
+            case TraceEventType::LockRelease:
+                span("lock held", LockSpan, trace, record);
+                break;
+            }
+        }
+
+        void instant(const char* name, const ThreadTrace& trace,
+                     const TraceRecord& record) {
+            begin_event(name, "i", trace.tid);
+            out << ",\"s\":\"t\",\"ts\":" << to_us(record.ticks)
+                << ",\"args\":{\"object\":\"" << record.object << "\"}}";
+        }
+
+        // A complete event, if its begin was traced
+        void span(const char* name, Span kind, ThreadTrace& trace,
+                  const TraceRecord& record) {
+            auto it = trace.open[kind].find(record.object);
+            if (it == trace.open[kind].end()) {
+                return;
+            }
+            uint64_t begin = it->second;
+            trace.open[kind].erase(it);
+            begin_event(name, "X", trace.tid);
+            out << ",\"ts\":" << to_us(begin)
+                << ",\"dur\":" << to_us(record.ticks) - to_us(begin)
+                << ",\"args\":{\"object\":\"" << record.object << "\"}}";
+        }
+
+        void begin_event(const char* name, const char* phase, uint32_t tid) {
+            out << (first ? "\n" : ",\n") << "{\"name\":\"" << name
+                << "\",\"ph\":\"" << phase << "\",\"pid\":1,\"tid\":" << tid;
+            first = false;
+        }
+
+        double to_us(uint64_t ticks) const {
+            return (ticks - tick0) * ns_per_tick / 1000;
+        }
+
+        Registry& r;
+        std::ofstream out; // Written by the collector thread, then finish()
+        const uint64_t tick0;
+        const uint64_t ns0;
+        double ns_per_tick;
+        bool first;
+        uint64_t exited_dropped = 0;
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool stopping; // Protected by mutex
+        std::thread thread;
+    };
+
+    struct Registry {
+        // Stop the collector if stop() is never called
+        ~Registry() {
+            if (collector) {
+                collector->finish();
+            }
+        }
+
+        std::mutex control; // Serializes start(...) and stop()
+        std::unique_ptr<Collector> collector; // Protected by control
+        std::mutex mutex;
+        std::vector<std::shared_ptr<ThreadTrace>> threads; // Protected by mutex
+        uint32_t next_tid = 1; // Protected by mutex
+    };
+
+    static Registry& registry() {
+        static Registry r;
+        return r;
+    }
+
+    // Unregisters the ring of the thread when it exits
+    struct ThreadExit {
+        std::shared_ptr<ThreadTrace> trace;
+
+        ~ThreadExit() {
+            current = nullptr;
+            thread_exited = true;
+            trace->exited.store(true, std::memory_order_release);
+        }
+    };
+
+    // The first event of the thread. Returns nullptr if the thread is
+    // exiting, and its ring is gone.
+    static ThreadTrace* register_thread() {
+        if (thread_exited) {
+            return nullptr;
+        }
+        Registry& r = registry();
+        std::shared_ptr<ThreadTrace> trace;
+        {
+            std::lock_guard<std::mutex> guard(r.mutex); // Enter critical section
+            trace = std::make_shared<ThreadTrace>(r.next_tid++);
+            r.threads.push_back(trace);
+        } // Leave critical section
+        thread_local ThreadExit exit { trace };
+        current = trace.get();
+        return current;
+    }
+
+    static inline std::atomic<bool> enabled {false};
+    static inline thread_local ThreadTrace* current = nullptr;
+    static inline thread_local bool thread_exited = false;
+};
+
+#endif // ExecutionTracer_h
\ No newline at end of file
@@ -0,0 +1,124 @@
+#include "../mutex/data_mutex.h"
+#include "../task_queue/simple_serial_task_queue.h"
+#include "../task_queue/task_queue.h"
+#include "execution_tracer.h"
+
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef EXECUTION_TRACER
+#error "Build this test with -DEXECUTION_TRACER"
+#endif
+
+const char* TRACE_FILE = "execution_trace.json";
+
+std::string read_file(const char* path) {
+    std::ifstream in(path);
+    std::stringstream s;
+    s << in.rdbuf();
+    return s.str();
+}
+
+size_t count_events(const std::string& trace, const std::string& name) {
+    std::string pattern = "{\"name\":\"" + name + "\"";
+    size_t n = 0;
+    for (size_t i = trace.find(pattern) ; i != std::string::npos ;
+         i = trace.find(pattern, i + 1)) {
+        ++n;
+    }
+    return n;
+}
+
+void test_trace_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    assert(ExecutionTracer::start(TRACE_FILE));
+    assert(ExecutionTracer::is_running());
+    // One trace at a time
+    assert(!ExecutionTracer::start(TRACE_FILE));
+
+    const size_t THREADS = 4;
+    const size_t TASKS = 100;
+    DataMutex<size_t> counter(0);
+    {
+        TaskQueue q(THREADS);
+        std::vector<std::future<void>> futures;
+        for (size_t i = 0 ; i < TASKS ; ++i) {
+            futures.emplace_back(q.dispatch([&counter] {
+                counter.lock().data() += 1;
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }));
+        }
+        for (std::future<void>& f: futures) {
+            f.wait();
+        }
+    } // The workers exit here and the collector drains their rings
+
+    DataMutex<size_t> other(0);
+    {
+        SimpleSerialTaskQueue q;
+        for (size_t i = 0 ; i < TASKS ; ++i) {
+            q.dispatch([&counter, &other] {
+                auto [a, b] = lock_all(counter, other);
+                b.data() = a.data()++;
+            });
+        }
+        q.wait();
+    }
+
+    uint64_t dropped = ExecutionTracer::stop();
+    assert(!ExecutionTracer::is_running());
+    assert(dropped == 0);
+    assert(counter.lock().data() == 2 * TASKS);
+
+    std::string trace = read_file(TRACE_FILE);
+    std::cout << "Open " << TRACE_FILE << " in ui.perfetto.dev or "
+              << "chrome://tracing, " << trace.size() << " bytes" << std::endl;
+    assert(trace.rfind("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 0) == 0);
+    assert(trace.back() == '}');
+    assert(count_events(trace, "enqueue") == 2 * TASKS);
+    assert(count_events(trace, "dequeue") == 2 * TASKS);
+    assert(count_events(trace, "task") == 2 * TASKS);
+    // One from each TaskQueue task, two from each lock_all(...)
+    assert(count_events(trace, "lock held") == 3 * TASKS);
+    // The workers park at least once before the first task comes in
+    assert(count_events(trace, "parked") > 0);
+    // The dispatching thread and the workers
+    assert(count_events(trace, "thread_name") >= THREADS + 2);
+
+    // Nothing is recorded once stopped
+    counter.lock().data() = 0;
+    assert(read_file(TRACE_FILE) == trace);
+}
+
+void test_dropped_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    // More events than a ring holds, faster than the collector drains them:
+    // each one is either in the trace or counted as dropped. The cost per
+    // event is measured by benchmark/primitives_benchmark.cpp.
+    const size_t EVENTS = 4 * ExecutionTracer::RING_CAPACITY;
+    int object = 0;
+    assert(ExecutionTracer::start(TRACE_FILE));
+    for (size_t i = 0 ; i < EVENTS ; ++i) {
+        ExecutionTracer::record(TraceEventType::Enqueue, &object);
+    }
+    uint64_t dropped = ExecutionTracer::stop();
+
+    std::string trace = read_file(TRACE_FILE);
+    size_t recorded = count_events(trace, "enqueue");
+    std::cout << "Recorded: " << recorded << ", dropped: " << dropped << std::endl;
+    assert(recorded + dropped == EVENTS);
+}
+
+int main() {
+    test_trace_example();
+    test_dropped_example();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,345 @@
+#ifndef BroadcastRingBuffer_h
+#define BroadcastRingBuffer_h
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+// A hook between the atomic operations for the stress tests to perturb the
+// thread schedule. See stress/stress.h.
+#ifndef SCHEDULE_POINT
+#define SCHEDULE_POINT()
+#endif
+
+// BroadcastRingBuffer
+//     A thread-safe single-producer-multi-consumer circular buffer where every
+//     consumer receives every element, in the style of the LMAX Disruptor.
+//     The producer writes each element into the ring once, and each consumer
+//     has its own read cursor, so fanning a stream out to N consumers doesn't
+//     cost N copies of it as one SPSCRingBuffer per consumer does.
+//
+//     The cursors are monotonic 64-bit positions. The producer publishes the
+//     next position to write with release ordering, and each consumer
+//     publishes its next position to read the same way, in its own cache
+//     line. The consumers read the elements right in the ring: claim_read()
+//     gives a batch of contiguous elements and commit_read() releases them.
+//
+//            slowest consumer    other consumers       producer
+//                   |              |       |              |
+//                   v              v       v              v
+//     +---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+
+//     |   |   |   | * | * | * | * | * | * | * | * | * | * |   |   |   |
+//     +---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+
+//
+//     With the Gated policy, the producer never overwrites an element that a
+//     consumer hasn't read: it gates on the slowest consumer and write()
+//     returns fewer elements than asked when the ring is full. The producer
+//     caches the slowest cursor and only scans the consumers again when the
+//     cached one doesn't leave enough room.
+//
+//     With the Lossy policy, the producer never waits. It overwrites the
+//     oldest elements, and a consumer that falls more than capacity behind
+//     skips to the oldest element left and counts the ones it lost. Every
+//     slot has a sequence number, odd while the producer writes it and
+//     2 * position + 2 once it holds the element at that position, so a
+//     consumer can tell if the elements it read in place were overwritten
+//     meanwhile, the same way a seqlock reader does. That needs T to be
+//     trivially copyable, since a consumer may copy a half-written element
+//     before finding out it has to throw it away, so the policy is a template
+//     parameter and the Lossy one rejects other types at compile time.
+//
+//     The capacity is rounded up to a power of two.
+//
+// Usage:
+//     BroadcastRingBuffer<Quote> ring(1024, 2); // 2 consumers
+//
+//     ring.write(quote); // Producer thread
+//
+//     // Consumer thread of consumer 1
+//     BroadcastRingBuffer<Quote>::Batch b = ring.claim_read(1);
+//     for (size_t i = 0 ; i < b.size ; ++i) {
+//         handle(b.data[i]);
+//     }
+//     ring.commit_read(1, b.size);
+//
+//     BroadcastRingBuffer<Quote, BroadcastPolicy::Lossy> lossy(1024, 2);
+enum class BroadcastPolicy {
+    Gated,
+    Lossy,
+};
+
+template<class T, BroadcastPolicy P = BroadcastPolicy::Gated>
+class BroadcastRingBuffer final {
+    static_assert(P == BroadcastPolicy::Gated ||
+                  std::is_trivially_copyable<T>::value,
+                  "The Lossy policy copies elements that may be overwritten meanwhile");
+public:
+    typedef BroadcastPolicy Policy;
+
+    // Contiguous elements claimed by a consumer, and the number of elements
+    // it lost before them (always 0 with the Gated policy)
+    struct Batch {
+        const T* data;
+        size_t size;
+        uint64_t lost;
+    };
+
+    BroadcastRingBuffer(size_t capacity, size_t consumers)
+        : buffer(round_up_to_power_of_two(capacity))
+        , mask(buffer.size() - 1)
+        , cursors(consumers)
+        , published(0) {
+        assert(capacity > 0);
+        assert(consumers > 0);
+        if constexpr (P == Policy::Lossy) {
+            sequences.reset(new std::atomic<uint64_t>[buffer.size()]);
+            for (size_t i = 0 ; i < buffer.size() ; ++i) {
+                sequences[i].store(0, std::memory_order_relaxed);
+            }
+        }
+        // Make sure constructor is always built first
+        std::atomic_thread_fence(std::memory_order::memory_order_seq_cst);
+    }
+
+    ~BroadcastRingBuffer() = default;
+
+    // Runs on producer thread. Returns the number of written elements, which
+    // is less than count only with the Gated policy when the ring is full.
+    size_t write(const T& data) {
+        return write(&data, 1);
+    }
+
+    // Runs on producer thread
+    size_t write_all(const std::vector<T>& data) {
+        return write(data.data(), data.size());
+    }
+
+    // Runs on producer thread
+    size_t write(const T* data, size_t count) {
+        if (count == 0) {
+            return 0;
+        }
+        uint64_t position = producer.position;
+        size_t num = count;
+        if constexpr (P == Policy::Gated) {
+            if (free_space(position) < count) {
+                // Not enough room by the cached slowest cursor. Scan again.
+                producer.cached_slowest = slowest_cursor();
+                SCHEDULE_POINT();
+            }
+            num = std::min(count, free_space(position));
+            for (size_t i = 0 ; i < num ; ++i) {
+                buffer[(position + i) & mask] = data[i];
+            }
+        } else {
+            for (size_t i = 0 ; i < num ; ++i) {
+                uint64_t p = position + i;
+                std::atomic<uint64_t>& sequence = sequences[p & mask];
+                sequence.store(2 * p + 1, std::memory_order_relaxed);
+                // Keep the element writes below the odd sequence
+                std::atomic_thread_fence(std::memory_order_release);
+                std::memcpy(&buffer[p & mask], &data[i], sizeof(T));
+                sequence.store(2 * p + 2, std::memory_order_release);
+            }
+        }
+        if (num == 0) {
+            return 0;
+        }
+        SCHEDULE_POINT();
+        producer.position = position + num;
+        published.store(producer.position, std::memory_order_release);
+        return num;
+    }
+
+    // Runs on the thread of the consumer-th consumer. At most max contiguous
+    // elements, readable in place until commit_read(). The batch is empty if
+    // there is nothing new, and stops at the end of the ring, so the elements
+    // past the end come in the next batch.
+    Batch claim_read(size_t consumer,
+                     size_t max = std::numeric_limits<size_t>::max()) {
+        assert(consumer < cursors.size());
+        Consumer& c = cursors[consumer];
+        uint64_t lost = 0;
+        if (c.cached_published == c.position) {
+            // Nothing left by the cached producer cursor. Load the newest one.
+            c.cached_published = published.load(std::memory_order_acquire);
+            SCHEDULE_POINT();
+        }
+        if constexpr (P == Policy::Lossy) {
+            lost = skip_overwritten(c);
+        }
+        size_t index = c.position & mask;
+        size_t num = std::min<uint64_t>(c.cached_published - c.position, max);
+        num = std::min(num, buffer.size() - index);
+        return Batch { buffer.data() + index, num, lost };
+    }
+
+    // Runs on the thread of the consumer-th consumer. Release the first n
+    // elements of the last claimed batch. With the Lossy policy, returns
+    // false if the producer has overwritten them while they were being read,
+    // so whatever was read from them must be dropped. The next claim_read()
+    // reports them as lost.
+    bool commit_read(size_t consumer, size_t n) {
+        assert(consumer < cursors.size());
+        Consumer& c = cursors[consumer];
+        assert(n <= c.cached_published - c.position);
+        if (n == 0) {
+            return true;
+        }
+        if constexpr (P == Policy::Lossy) {
+            // The producer overwrites the slots in order, so if the first
+            // slot of the batch is intact, all the others are
+            std::atomic_thread_fence(std::memory_order_acquire);
+            SCHEDULE_POINT();
+            if (sequences[c.position & mask].load(std::memory_order_relaxed) !=
+                2 * c.position + 2) {
+                return false;
+            }
+        }
+        c.position += n;
+        c.cursor.store(c.position, std::memory_order_release);
+        return true;
+    }
+
+    // Runs on the thread of the consumer-th consumer
+    std::optional<T> read(size_t consumer) {
+        std::vector<T> data = read(consumer, 1);
+        if (data.empty()) {
+            return std::nullopt;
+        }
+        return std::optional<T>(std::move(data[0]));
+    }
+
+    // Runs on the thread of the consumer-th consumer
+    std::vector<T> read_all(size_t consumer) {
+        return read(consumer, capacity());
+    }
+
+    // Runs on the thread of the consumer-th consumer. The number of elements
+    // it has lost so far. Always 0 with the Gated policy.
+    uint64_t lost(size_t consumer) const {
+        assert(consumer < cursors.size());
+        return cursors[consumer].lost;
+    }
+
+    size_t capacity() const {
+        return buffer.size();
+    }
+
+    size_t consumers() const {
+        return cursors.size();
+    }
+
+    static constexpr Policy policy() {
+        return P;
+    }
+
+    // Disallowed operations
+    BroadcastRingBuffer(const BroadcastRingBuffer& other) = delete;
+    BroadcastRingBuffer(BroadcastRingBuffer&& other) = delete;
+    BroadcastRingBuffer& operator=(const BroadcastRingBuffer& other) = delete;
+    BroadcastRingBuffer& operator=(BroadcastRingBuffer&& other) = delete;
+
+private:
+    // The state of one consumer. Only cursor is read by the producer, and
+    // the rest is touched on the consumer's thread only.
+    struct alignas(64) Consumer {
+        std::atomic<uint64_t> cursor { 0 }; // next position to read
+        uint64_t position = 0; // same as cursor
+        uint64_t cached_published = 0; // last loaded producer cursor
+        uint64_t lost = 0;
+    };
+
+    // The state of the producer. Touched on producer thread only.
+    struct alignas(64) Producer {
+        uint64_t position = 0; // next position to write
+        uint64_t cached_slowest = 0; // last loaded slowest consumer cursor
+    };
+
+    // Runs on the consumer thread. Copy out at most count elements.
+    std::vector<T> read(size_t consumer, size_t count) {
+        std::vector<T> values;
+        while (values.size() < count) {
+            Batch b = claim_read(consumer, count - values.size());
+            if (b.size == 0) {
+                break;
+            }
+            size_t old_size = values.size();
+            values.insert(values.end(), b.data, b.data + b.size);
+            if (!commit_read(consumer, b.size)) {
+                // Overwritten while being copied. Claim again from the
+                // oldest element left.
+                values.resize(old_size);
+            }
+        }
+        return values;
+    }
+
+    // Runs on the consumer thread, with the Lossy policy only. If the
+    // consumer has fallen more than capacity behind, move it to the oldest
+    // element still in the ring. Returns the number of skipped elements.
+    uint64_t skip_overwritten(Consumer& c) {
+        uint64_t skipped = 0;
+        while (c.position < c.cached_published) {
+            uint64_t sequence = sequences[c.position & mask].load(std::memory_order_acquire);
+            if (sequence == 2 * c.position + 2) {
+                break;
+            }
+            // The slot has been taken by a newer element, so the producer has
+            // moved at least a whole ring past us
+            c.cached_published = published.load(std::memory_order_acquire);
+            SCHEDULE_POINT();
+            uint64_t oldest = c.cached_published > capacity()
+                                  ? c.cached_published - capacity() : 0;
+            // Skip at least one element, in case the producer is rewriting
+            // the oldest slot right now
+            uint64_t next = std::max(oldest, c.position + 1);
+            skipped += next - c.position;
+            c.position = next;
+        }
+        if (skipped) {
+            c.lost += skipped;
+            c.cursor.store(c.position, std::memory_order_release);
+        }
+        return skipped;
+    }
+
+    // Runs on producer thread
+    size_t free_space(uint64_t position) const {
+        return capacity() - (position - producer.cached_slowest);
+    }
+
+    // Runs on producer thread
+    uint64_t slowest_cursor() const {
+        uint64_t slowest = std::numeric_limits<uint64_t>::max();
+        for (const Consumer& c: cursors) {
+            slowest = std::min(slowest, c.cursor.load(std::memory_order_acquire));
+        }
+        return slowest;
+    }
+
+    static size_t round_up_to_power_of_two(size_t n) {
+        size_t power = 1;
+        while (power < n) {
+            power <<= 1;
+        }
+        return power;
+    }
+
+    std::vector<T> buffer;
+    const size_t mask;
+    // Per-slot sequence numbers, with the Lossy policy only
+    std::unique_ptr<std::atomic<uint64_t>[]> sequences;
+    std::vector<Consumer> cursors;
+    Producer producer;
+    alignas(64) std::atomic<uint64_t> published; // next position to write
+};
+
+#endif // BroadcastRingBuffer_h
@@ -0,0 +1,161 @@
+#include "broadcast_ring_buffer.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+const size_t CONSUMERS = 3;
+const uint64_t NUM_OF_MESSAGES = 100000;
+
+struct Quote {
+    uint64_t id;
+    double price;
+};
+
+void test_gated_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    BroadcastRingBuffer<Quote> ring(64, CONSUMERS);
+    std::atomic<bool> go(false);
+
+    std::thread producer([&] {
+        while (!go);
+        uint64_t id = 0;
+        while (id < NUM_OF_MESSAGES) {
+            Quote q = { id, id * 0.5 };
+            if (ring.write(q) == 1) {
+                ++id;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    // Every consumer gets every quote, in order, by reading them in place
+    std::vector<std::thread> consumers;
+    std::vector<uint64_t> received(CONSUMERS, 0);
+    for (size_t c = 0 ; c < CONSUMERS ; ++c) {
+        consumers.emplace_back([&, c] {
+            while (!go);
+            while (received[c] < NUM_OF_MESSAGES) {
+                BroadcastRingBuffer<Quote>::Batch b = ring.claim_read(c);
+                if (b.size == 0) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                assert(b.lost == 0);
+                for (size_t i = 0 ; i < b.size ; ++i) {
+                    assert(b.data[i].id == received[c] + i);
+                    assert(b.data[i].price == b.data[i].id * 0.5);
+                }
+                assert(ring.commit_read(c, b.size));
+                received[c] += b.size;
+            }
+        });
+    }
+
+    go = true;
+    producer.join();
+    for (std::thread& t: consumers) {
+        t.join();
+    }
+    for (size_t c = 0 ; c < CONSUMERS ; ++c) {
+        std::cout << "consumer " << c << " received " << received[c]
+                  << " quotes" << std::endl;
+        assert(ring.lost(c) == 0);
+    }
+}
+
+void test_gated_full_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    // The capacity 5 is rounded up to 8
+    BroadcastRingBuffer<int> ring(5, 2);
+    assert(ring.capacity() == 8);
+    std::vector<int> data = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+    assert(ring.write_all(data) == 8);
+
+    // The slowest consumer holds the producer back
+    assert(ring.read_all(0).size() == 8);
+    assert(ring.write(8) == 0);
+    std::optional<int> v = ring.read(1);
+    assert(v && *v == 0);
+    assert(ring.write(8) == 1);
+    assert(ring.write(9) == 0);
+
+    // Claims stop at the end of the ring
+    BroadcastRingBuffer<int>::Batch b = ring.claim_read(1);
+    assert(b.size == 7 && b.data[0] == 1);
+    assert(ring.commit_read(1, 7));
+    b = ring.claim_read(1);
+    assert(b.size == 1 && b.data[0] == 8);
+    assert(ring.commit_read(1, 1));
+    std::cout << "ok" << std::endl;
+}
+
+void test_lossy_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    typedef BroadcastRingBuffer<uint64_t, BroadcastPolicy::Lossy> Ring;
+    Ring ring(8, 2);
+
+    // The producer never waits for the consumers
+    for (uint64_t i = 0 ; i < 20 ; ++i) {
+        assert(ring.write(i) == 1);
+    }
+
+    // Consumer 0 detects it has lost the 12 oldest values
+    Ring::Batch b = ring.claim_read(0);
+    assert(b.lost == 12);
+    assert(b.size == 4 && b.data[0] == 12); // Up to the end of the ring
+    assert(ring.commit_read(0, b.size));
+    b = ring.claim_read(0);
+    assert(b.lost == 0 && b.size == 4 && b.data[0] == 16);
+    assert(ring.commit_read(0, b.size));
+
+    // Consumer 1 claims a batch, and the producer overwrites it before the
+    // consumer is done with it
+    b = ring.claim_read(1, 4);
+    assert(b.lost == 12 && b.size == 4 && b.data[0] == 12);
+    ring.write(20);
+    assert(!ring.commit_read(1, b.size));
+    std::vector<uint64_t> rest = ring.read_all(1);
+    assert(ring.lost(1) == 13);
+    assert(rest.size() == 8 && rest[0] == 13 && rest[7] == 20);
+    std::cout << "consumer 1 lost " << ring.lost(1) << " values" << std::endl;
+
+    // A slow consumer keeps up with the stream, with gaps
+    std::atomic<bool> done(false);
+    std::thread producer([&] {
+        for (uint64_t i = 21 ; i < 21 + NUM_OF_MESSAGES ; ++i) {
+            ring.write(i);
+        }
+        done = true;
+    });
+    uint64_t last = 19;
+    uint64_t received = 0;
+    while (!done || ring.claim_read(0).size) {
+        for (uint64_t v: ring.read_all(0)) {
+            // Values only go up, and each gap is counted as lost
+            assert(v > last);
+            last = v;
+            ++received;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(10));
+    }
+    assert(last == 20 + NUM_OF_MESSAGES);
+    assert(8 + received + ring.lost(0) == 21 + NUM_OF_MESSAGES);
+    std::cout << "consumer 0 received " << received << ", lost "
+              << ring.lost(0) << std::endl;
+    producer.join();
+}
+
+int main() {
+    test_gated_example();
+    test_gated_full_example();
+    test_lossy_example();
+    return 0;
+}
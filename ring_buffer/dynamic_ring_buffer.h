@@ -0,0 +1,284 @@
+#ifndef DynamicRingBuffer_h
+#define DynamicRingBuffer_h
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <limits>
+#include <memory>
+#include <new>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// A hook between the atomic operations for the stress tests to perturb the
+// thread schedule. See stress/stress.h.
+#ifndef SCHEDULE_POINT
+#define SCHEDULE_POINT()
+#endif
+
+// DynamicSPSCRingBuffer
+//     An unbounded thread-safe single-producer-single-consumer queue. It has
+//     the same interface as SPSCRingBuffer, except write() never fails, so
+//     the memory scales with the actual backlog instead of a worst-case
+//     capacity chosen up front.
+//
+//     The queue is a linked chain of fixed-size blocks. The producer appends
+//     to the tail block and the consumer takes from the head block. Each
+//     block has a write counter published by the producer with release
+//     ordering, and a next pointer published the same way once the block is
+//     full. When the backlog spans more than one block, the producer and the
+//     consumer only touch their own blocks.
+//
+//        head (consumer)                    tail (producer)
+//            |                                   |
+//            v                                   v
+//     +-------------+     +-------------+     +-------------+
+//     | * * * * * * | --> | * * * * * * | --> | * * *       |
+//     +-------------+     +-------------+     +-------------+
+//       ^                                             ^
+//     read                                          written
+//
+//     Drained blocks are recycled rather than freed: the consumer pushes them
+//     onto a free list and the producer takes them back from there when it
+//     needs a new block. The producer grabs the whole list at once, so there
+//     is no ABA problem. At most max_free_blocks are kept. The blocks beyond
+//     that are freed, so an idle queue gives back the memory of a burst.
+//
+// Usage:
+//     DynamicSPSCRingBuffer<int> queue;
+//     queue.write(1); // Producer thread. Always succeeds
+//     std::optional<int> v = queue.read(); // Consumer thread
+template<class T>
+class DynamicSPSCRingBuffer final {
+public:
+    explicit DynamicSPSCRingBuffer(size_t block_capacity = 256,
+                                   size_t max_free_blocks = 4)
+        : block_size(block_capacity)
+        , max_free(max_free_blocks)
+        , free_list(nullptr)
+        , free_blocks(0)
+        , blocks(0)
+        , producer_free(nullptr) {
+        assert(block_capacity > 0);
+        tail = new_block();
+        head = tail;
+        head_read = 0;
+        // Make sure constructor is always built first
+        std::atomic_thread_fence(std::memory_order::memory_order_seq_cst);
+    }
+
+    ~DynamicSPSCRingBuffer() {
+        // Destroy the unread elements and the chain
+        Block* b = head;
+        size_t r = head_read;
+        while (b) {
+            size_t w = b->written.load(std::memory_order_relaxed);
+            for (size_t i = r ; i < w ; ++i) {
+                b->slots[i].~T();
+            }
+            Block* next = b->next.load(std::memory_order_relaxed);
+            delete_block(b);
+            b = next;
+            r = 0;
+        }
+        // Free the recycled blocks
+        for (Block* list: { producer_free, free_list.load(std::memory_order_relaxed) }) {
+            while (list) {
+                Block* next = list->next_free;
+                delete_block(list);
+                list = next;
+            }
+        }
+    }
+
+    // Runs on producer thread. Always writes the data.
+    size_t write(const T& data) {
+        return write(&data, 1);
+    }
+
+    // Runs on producer thread. Always writes all the data.
+    size_t write_all(const std::vector<T>& data) {
+        return write(data.data(), data.size());
+    }
+
+    // Runs on producer thread. Always writes the count elements at data.
+    size_t write(const T* data, size_t count) {
+        size_t done = 0;
+        while (done < count) {
+            Block* b = tail;
+            size_t w = b->written.load(std::memory_order_relaxed);
+            if (w == block_size) {
+                // Initialize the new block before publishing it by next, so
+                // the consumer sees its elements once it sees the block
+                Block* nb = acquire_block();
+                size_t n = std::min(count - done, block_size);
+                std::uninitialized_copy(data + done, data + done + n, nb->slots);
+                nb->written.store(n, std::memory_order_relaxed);
+                SCHEDULE_POINT();
+                b->next.store(nb, std::memory_order_release);
+                tail = nb;
+                done += n;
+                continue;
+            }
+            size_t n = std::min(count - done, block_size - w);
+            std::uninitialized_copy(data + done, data + done + n, b->slots + w);
+            SCHEDULE_POINT();
+            b->written.store(w + n, std::memory_order_release);
+            done += n;
+        }
+        return count;
+    }
+
+    // Runs on consumer thread
+    std::optional<T> read() {
+        std::vector<T> data = read(1);
+        if (data.empty()) {
+            return std::nullopt;
+        }
+        return std::optional<T>(std::move(data[0]));
+    }
+
+    // Runs on consumer thread
+    std::vector<T> read_all() {
+        return read(std::numeric_limits<size_t>::max());
+    }
+
+    // Runs on consumer thread. Only a hint while the producer is writing.
+    bool empty() const {
+        Block* b = head;
+        size_t w = b->written.load(std::memory_order_acquire);
+        if (head_read < w) {
+            return false;
+        }
+        // A block is published by next with at least one element in it
+        return w < block_size || !b->next.load(std::memory_order_acquire);
+    }
+
+    // The number of blocks currently allocated, in the chain or in the free
+    // list. Only a hint when the queue is in use.
+    size_t allocated_blocks() const {
+        return blocks.load(std::memory_order_relaxed);
+    }
+
+    size_t block_capacity() const {
+        return block_size;
+    }
+
+    // Disallowed operations
+    DynamicSPSCRingBuffer(const DynamicSPSCRingBuffer& other) = delete;
+    DynamicSPSCRingBuffer(DynamicSPSCRingBuffer&& other) = delete;
+    DynamicSPSCRingBuffer& operator=(const DynamicSPSCRingBuffer& other) = delete;
+    DynamicSPSCRingBuffer& operator=(DynamicSPSCRingBuffer&& other) = delete;
+
+private:
+    struct Block {
+        explicit Block(size_t capacity)
+            : slots(std::allocator<T>().allocate(capacity))
+            , written(0)
+            , next(nullptr)
+            , next_free(nullptr) {}
+
+        T* const slots;
+        // Number of elements constructed in slots. Written by producer only
+        std::atomic<size_t> written;
+        // The following block. Set by producer once this one is full
+        std::atomic<Block*> next;
+        // The following block in the free list
+        Block* next_free;
+    };
+
+    // Runs on consumer thread
+    std::vector<T> read(size_t count) {
+        std::vector<T> values;
+        while (values.size() < count) {
+            Block* b = head;
+            size_t w = b->written.load(std::memory_order_acquire);
+            SCHEDULE_POINT();
+            if (head_read == w) {
+                // The producer only leaves a block when it's full
+                if (w < block_size) {
+                    break;
+                }
+                Block* next = b->next.load(std::memory_order_acquire);
+                if (!next) {
+                    break;
+                }
+                // The producer has moved on and never touches b again
+                head = next;
+                head_read = 0;
+                retire_block(b);
+                continue;
+            }
+            size_t n = std::min(count - values.size(), w - head_read);
+            for (size_t i = head_read ; i < head_read + n ; ++i) {
+                values.emplace_back(std::move(b->slots[i]));
+                b->slots[i].~T();
+            }
+            head_read += n;
+        }
+        return values;
+    }
+
+    // Runs on producer thread. A recycled block if any, or a new one.
+    Block* acquire_block() {
+        if (!producer_free) {
+            // Take the whole list, so nothing can be popped under us
+            producer_free = free_list.exchange(nullptr, std::memory_order_acquire);
+        }
+        if (!producer_free) {
+            return new_block();
+        }
+        Block* b = producer_free;
+        producer_free = b->next_free;
+        free_blocks.fetch_sub(1, std::memory_order_relaxed);
+        b->written.store(0, std::memory_order_relaxed);
+        b->next.store(nullptr, std::memory_order_relaxed);
+        b->next_free = nullptr;
+        return b;
+    }
+
+    // Runs on consumer thread. b is drained and the producer is done with it.
+    void retire_block(Block* b) {
+        // Only the consumer increases free_blocks, so the check is exact from
+        // its point of view. The producer may be taking some out meanwhile.
+        if (free_blocks.load(std::memory_order_relaxed) >= max_free) {
+            delete_block(b);
+            return;
+        }
+        free_blocks.fetch_add(1, std::memory_order_relaxed);
+        b->next_free = free_list.load(std::memory_order_relaxed);
+        while (!free_list.compare_exchange_weak(b->next_free, b,
+                                                std::memory_order_release,
+                                                std::memory_order_relaxed));
+    }
+
+    Block* new_block() {
+        blocks.fetch_add(1, std::memory_order_relaxed);
+        return new Block(block_size);
+    }
+
+    void delete_block(Block* b) {
+        std::allocator<T>().deallocate(b->slots, block_size);
+        delete b;
+        blocks.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    const size_t block_size;
+    const size_t max_free;
+
+    // Shared by both threads
+    std::atomic<Block*> free_list; // Pushed by consumer, taken by producer
+    std::atomic<size_t> free_blocks; // Blocks in free_list and producer_free
+    std::atomic<size_t> blocks;
+
+    // Producer thread only
+    alignas(64) Block* tail;
+    Block* producer_free; // Blocks taken from free_list, not used yet
+
+    // Consumer thread only
+    alignas(64) Block* head;
+    size_t head_read; // next index to read in head
+};
+
+#endif // DynamicRingBuffer_h
\ No newline at end of file
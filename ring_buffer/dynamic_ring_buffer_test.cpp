@@ -0,0 +1,120 @@
+#include "dynamic_ring_buffer.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+const size_t NUM_OF_MESSAGES = 100000;
+const size_t BLOCK_CAPACITY = 16;
+const size_t MAX_FREE_BLOCKS = 2;
+
+void test_burst_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    DynamicSPSCRingBuffer<std::string> queue(BLOCK_CAPACITY, MAX_FREE_BLOCKS);
+    assert(queue.allocated_blocks() == 1);
+    assert(queue.empty());
+
+    // A burst much larger than a block is always accepted
+    const size_t BURST = 100 * BLOCK_CAPACITY + 3;
+    for (size_t i = 0 ; i < BURST ; ++i) {
+        assert(queue.write(std::to_string(i)) == 1);
+    }
+    std::cout << "blocks after a burst of " << BURST << ": "
+              << queue.allocated_blocks() << std::endl;
+    assert(queue.allocated_blocks() == BURST / BLOCK_CAPACITY + 1);
+    assert(!queue.empty());
+
+    std::vector<std::string> all = queue.read_all();
+    assert(all.size() == BURST);
+    for (size_t i = 0 ; i < BURST ; ++i) {
+        assert(all[i] == std::to_string(i));
+    }
+    assert(!queue.read().has_value());
+    assert(queue.empty());
+
+    // The drained blocks beyond MAX_FREE_BLOCKS are freed
+    std::cout << "blocks after draining: " << queue.allocated_blocks()
+              << std::endl;
+    assert(queue.allocated_blocks() <= MAX_FREE_BLOCKS + 2);
+
+    // And the kept ones are reused by the next burst
+    size_t before = queue.allocated_blocks();
+    for (size_t i = 0 ; i < 2 * BLOCK_CAPACITY ; ++i) {
+        queue.write(std::to_string(i));
+    }
+    assert(queue.allocated_blocks() == before);
+
+    // A drained full block is empty until the producer starts the next one
+    DynamicSPSCRingBuffer<std::string> full(BLOCK_CAPACITY);
+    for (size_t i = 0 ; i < BLOCK_CAPACITY ; ++i) {
+        full.write(std::to_string(i));
+    }
+    assert(full.read_all().size() == BLOCK_CAPACITY);
+    assert(full.empty());
+    full.write("next block");
+    assert(!full.empty());
+    assert(full.read() == std::optional<std::string>("next block"));
+    assert(full.empty());
+    // Leave some elements in the queue for the destructor
+}
+
+void test_producer_consumer_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    DynamicSPSCRingBuffer<size_t> queue(BLOCK_CAPACITY, MAX_FREE_BLOCKS);
+    std::atomic<bool> go(false);
+
+    std::thread producer([&] {
+        while (!go);
+        size_t id = 0;
+        while (id < NUM_OF_MESSAGES) {
+            if (id % 3) {
+                queue.write(id++);
+                continue;
+            }
+            std::vector<size_t> batch;
+            for (size_t i = 0 ; i < 7 && id < NUM_OF_MESSAGES ; ++i) {
+                batch.push_back(id++);
+            }
+            assert(queue.write_all(batch) == batch.size());
+        }
+    });
+
+    std::vector<size_t> messages;
+    std::thread consumer([&] {
+        while (!go);
+        while (messages.size() < NUM_OF_MESSAGES) {
+            if (messages.size() % 2) {
+                std::optional<size_t> m = queue.read();
+                if (m) {
+                    messages.push_back(*m);
+                }
+                continue;
+            }
+            std::vector<size_t> data = queue.read_all();
+            messages.insert(messages.end(), data.begin(), data.end());
+        }
+    });
+
+    go = true;
+    producer.join();
+    consumer.join();
+
+    for (size_t i = 0 ; i < NUM_OF_MESSAGES ; ++i) {
+        assert(messages[i] == i);
+    }
+    std::cout << NUM_OF_MESSAGES << " messages in order, "
+              << queue.allocated_blocks() << " blocks left" << std::endl;
+}
+
+int main() {
+    test_burst_example();
+    test_producer_consumer_example();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,214 @@
+#ifndef EventfdRingBuffer_h
+#define EventfdRingBuffer_h
+
+#include "ring_buffer.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+// A hook between the atomic operations for the stress tests to perturb the
+// thread schedule. See stress/stress.h.
+#ifndef SCHEDULE_POINT
+#define SCHEDULE_POINT()
+#endif
+
+// EventNotifier
+//     An eventfd, for a thread sleeping in epoll_wait(...) rather than on a
+//     condition variable. The fd is readable after notify() until clear().
+//     It's non-blocking, so clear() never blocks either.
+//
+// Usage:
+//     auto notifier = EventNotifier::create();
+//     assert(notifier);
+//     epoll_event ev { EPOLLIN, { .ptr = notifier.get() } };
+//     epoll_ctl(epoll_fd, EPOLL_CTL_ADD, notifier->fd(), &ev);
+//     notifier->notify(); // Any thread. epoll_wait(...) returns
+//     notifier->clear(); // The epoll thread
+class EventNotifier final {
+public:
+    // Returns nullptr if the eventfd can't be created
+    static std::unique_ptr<EventNotifier> create() {
+        int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0) {
+            return nullptr;
+        }
+        return std::unique_ptr<EventNotifier>(new EventNotifier(fd));
+    }
+
+    ~EventNotifier() {
+        close(event_fd);
+    }
+
+    int fd() const {
+        return event_fd;
+    }
+
+    // Runs on any thread. One syscall.
+    void notify() {
+        uint64_t one = 1;
+        // Fails only if the counter would overflow, when it's readable anyway
+        ssize_t n = write(event_fd, &one, sizeof(one));
+        (void)n;
+    }
+
+    // Runs on the waiting thread. One syscall.
+    void clear() {
+        uint64_t count;
+        // Fails with EAGAIN if there was nothing to clear
+        ssize_t n = read(event_fd, &count, sizeof(count));
+        (void)n;
+    }
+
+    // Disallowed operations
+    EventNotifier(const EventNotifier& other) = delete;
+    EventNotifier(EventNotifier&& other) = delete;
+    EventNotifier& operator=(const EventNotifier& other) = delete;
+    EventNotifier& operator=(EventNotifier&& other) = delete;
+
+private:
+    explicit EventNotifier(int fd): event_fd(fd) {}
+
+    const int event_fd;
+};
+
+// EventfdSPSCRingBuffer
+//     An SPSCRingBuffer whose consumer sleeps in epoll_wait(...) on fd()
+//     instead of spinning on read(). The producer notifies the eventfd only
+//     when the ring goes from empty to non-empty in the consumer's eyes, so a
+//     burst of writes costs one syscall, not one per element.
+//
+//     The consumer arms a flag when it finds the ring empty, then checks the
+//     ring again. The producer writes the data, then takes the flag and
+//     notifies if it was armed. Both sides put a sequentially consistent
+//     fence between the ring and the flag, so a write racing with the
+//     consumer going to sleep is either seen by the consumer's second check
+//     or notified.
+//
+//     The consumer must read until it gets nothing, which arms the flag,
+//     before sleeping again. Getting nothing costs a syscall to clear the
+//     eventfd, once per wakeup. It may see a wakeup with nothing to read,
+//     after it has read the data of a write racing with the arming.
+//
+// Usage:
+//     auto ring = EventfdSPSCRingBuffer<Completion>::create(1024);
+//     // Register ring->fd() with EPOLLIN in the epoll loop
+//     ring->write(completion); // Producer thread
+//
+//     // Consumer thread, once epoll_wait(...) reports ring->fd()
+//     std::vector<Completion> batch;
+//     while (!(batch = ring->read_all()).empty()) {
+//         handle(batch);
+//     }
+template<class T>
+class EventfdSPSCRingBuffer final {
+public:
+    // Returns nullptr if the eventfd can't be created
+    static std::unique_ptr<EventfdSPSCRingBuffer> create(size_t capacity) {
+        std::unique_ptr<EventNotifier> notifier = EventNotifier::create();
+        if (!notifier) {
+            return nullptr;
+        }
+        return std::unique_ptr<EventfdSPSCRingBuffer>(
+            new EventfdSPSCRingBuffer(capacity, std::move(notifier)));
+    }
+
+    ~EventfdSPSCRingBuffer() = default;
+
+    // Runs on producer thread
+    size_t write(const T& data) {
+        size_t n = ring.write(data);
+        if (n) {
+            notify();
+        }
+        return n;
+    }
+
+    // Runs on producer thread
+    size_t write_all(const std::vector<T>& data) {
+        size_t n = ring.write_all(data);
+        if (n) {
+            notify();
+        }
+        return n;
+    }
+
+    // Runs on consumer thread. Arms the notification if it's empty.
+    std::optional<T> read() {
+        std::optional<T> data = ring.read();
+        if (!data && arm()) {
+            data = ring.read();
+        }
+        return data;
+    }
+
+    // Runs on consumer thread. Arms the notification if it's empty.
+    std::vector<T> read_all() {
+        std::vector<T> data = ring.read_all();
+        if (data.empty() && arm()) {
+            data = ring.read_all();
+        }
+        return data;
+    }
+
+    // Register it with EPOLLIN
+    int fd() const {
+        return notifier->fd();
+    }
+
+    size_t capacity() const {
+        return ring.capacity();
+    }
+
+    // Disallowed operations
+    EventfdSPSCRingBuffer(const EventfdSPSCRingBuffer& other) = delete;
+    EventfdSPSCRingBuffer(EventfdSPSCRingBuffer&& other) = delete;
+    EventfdSPSCRingBuffer& operator=(const EventfdSPSCRingBuffer& other) = delete;
+    EventfdSPSCRingBuffer& operator=(EventfdSPSCRingBuffer&& other) = delete;
+
+private:
+    EventfdSPSCRingBuffer(size_t capacity, std::unique_ptr<EventNotifier> n)
+        : ring(capacity)
+        , notifier(std::move(n))
+        , armed(true) {}
+
+    // Runs on producer thread, after the data is in the ring
+    void notify() {
+        // Order the store of the write cursor before loading armed. Pairs
+        // with the fence in arm().
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        SCHEDULE_POINT();
+        if (armed.load(std::memory_order_relaxed)
+            && armed.exchange(false, std::memory_order_seq_cst)) {
+            notifier->notify();
+        }
+    }
+
+    // Runs on consumer thread, having found the ring empty. Returns true if
+    // the ring must be checked again, because a write may have come before
+    // the arming and skipped the notification.
+    bool arm() {
+        // Drop the readiness of the data read already before arming, so a
+        // notification coming after the arming isn't lost. It also drops a
+        // late notification of data read already, so it doesn't keep the fd
+        // readable.
+        notifier->clear();
+        SCHEDULE_POINT();
+        bool was_armed = armed.exchange(true, std::memory_order_seq_cst);
+        // Order the arming before the second load of the write cursor
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // If it was armed already, no write has skipped the notification
+        return !was_armed;
+    }
+
+    SPSCRingBuffer<T> ring;
+    const std::unique_ptr<EventNotifier> notifier;
+    alignas(64) std::atomic<bool> armed; // Notify on the next write
+};
+
+#endif // EventfdRingBuffer_h
\ No newline at end of file
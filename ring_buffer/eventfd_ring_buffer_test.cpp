@@ -0,0 +1,96 @@
+#include "eventfd_ring_buffer.h"
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+const uint64_t BURSTS = 200;
+const uint64_t BURST_SIZE = 50;
+
+void test_eventfd_ring_buffer_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    auto ring = EventfdSPSCRingBuffer<int>::create(8);
+    assert(ring);
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    assert(epoll_fd >= 0);
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    assert(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ring->fd(), &ev) == 0);
+
+    // Not readable while empty
+    assert(epoll_wait(epoll_fd, &ev, 1, 0) == 0);
+
+    // A burst of writes makes it readable once
+    assert(ring->write(1) == 1);
+    assert(ring->write_all({ 2, 3 }) == 2);
+    assert(epoll_wait(epoll_fd, &ev, 1, 0) == 1);
+    assert(ring->read_all() == std::vector<int>({ 1, 2, 3 }));
+    // Reading nothing arms it again and clears the readiness
+    assert(ring->read_all().empty());
+    assert(epoll_wait(epoll_fd, &ev, 1, 0) == 0);
+
+    assert(ring->write(4) == 1);
+    assert(epoll_wait(epoll_fd, &ev, 1, 0) == 1);
+    assert(ring->read() == 4);
+    assert(!ring->read());
+    assert(epoll_wait(epoll_fd, &ev, 1, 0) == 0);
+
+    close(epoll_fd);
+}
+
+void test_eventfd_ring_buffer_epoll_loop() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    auto ring = EventfdSPSCRingBuffer<uint64_t>::create(BURST_SIZE);
+    assert(ring);
+
+    // The consumer sleeps in epoll_wait(...) and drains in batches
+    uint64_t wakeups = 0;
+    std::thread consumer([&] {
+        int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        assert(epoll_fd >= 0);
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        assert(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ring->fd(), &ev) == 0);
+        uint64_t expected = 0;
+        while (expected < BURSTS * BURST_SIZE) {
+            assert(epoll_wait(epoll_fd, &ev, 1, -1) == 1);
+            ++wakeups;
+            std::vector<uint64_t> batch;
+            while (!(batch = ring->read_all()).empty()) {
+                for (uint64_t value: batch) {
+                    assert(value == expected);
+                    ++expected;
+                }
+            }
+        }
+        close(epoll_fd);
+    });
+
+    for (uint64_t b = 0 ; b < BURSTS ; ++b) {
+        for (uint64_t i = 0 ; i < BURST_SIZE ; ++i) {
+            while (!ring->write(b * BURST_SIZE + i)) {
+                std::this_thread::yield();
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    consumer.join();
+
+    std::cout << BURSTS * BURST_SIZE << " values in " << wakeups
+              << " wakeups" << std::endl;
+    assert(wakeups < BURSTS * BURST_SIZE / 2);
+}
+
+int main() {
+    test_eventfd_ring_buffer_example();
+    test_eventfd_ring_buffer_epoll_loop();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,252 @@
+#ifndef MirroredRingBuffer_h
+#define MirroredRingBuffer_h
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+// A hook between the atomic operations for the stress tests to perturb the
+// thread schedule. See stress/stress.h.
+#ifndef SCHEDULE_POINT
+#define SCHEDULE_POINT()
+#endif
+
+// MirroredRingBuffer
+//     A thread-safe single-producer-single-consumer circular byte buffer
+//     whose readable and writable regions are always contiguous in memory.
+//
+//     The storage is a memfd mapped twice, back-to-back, in the virtual
+//     memory, so the byte at address base + capacity + i is the byte at
+//     base + i. A region starting near the end of the first mapping simply
+//     runs into the second one, instead of being split into a first part and
+//     a second part as SPSCRingBuffer does. Decoders can parse the records
+//     right in the ring memory, even if they straddle the end of the buffer.
+//
+//           first mapping            second mapping
+//     +---+---+---+---+---+---+---+---+---+---+---+---+
+//     |   |   | * | * | * | * |   |   | * | * | * | * |
+//     +---+---+---+---+---+---+---+---+---+---+---+---+
+//               ^               ^
+//          read-cursor     write-cursor
+//
+//     The read and write cursors are monotonic 64-bit byte counters, so the
+//     buffer is empty when they are equal and full when they differ by the
+//     capacity. No byte is wasted on an end mark. Same as SPSCRingBuffer, the
+//     cursors are published with acquire-release ordering. Each side also
+//     caches the last cursor it loaded from the other side and only reloads
+//     it when the cached one doesn't allow the operation, which keeps the
+//     other side's cache line away in the steady state.
+//
+//     The capacity is rounded up to a multiple of the page size, or of the
+//     huge page size if huge pages are requested. Huge pages need the system
+//     to reserve some (/proc/sys/vm/nr_hugepages).
+//
+// Usage:
+//     auto ring = MirroredRingBuffer::create(64 * 1024);
+//     assert(ring);
+//
+//     // Producer thread
+//     MirroredRingBuffer::Region w = ring->writable_region();
+//     size_t n = encode(w.data, w.size); // Write records right in the ring
+//     ring->commit_write(n);
+//
+//     // Consumer thread
+//     MirroredRingBuffer::Region r = ring->readable_region();
+//     size_t n = decode(r.data, r.size); // No boundary handling needed
+//     ring->commit_read(n);
+class MirroredRingBuffer final {
+public:
+    struct Options {
+        bool huge_pages = false;
+        // Fault in all the pages at construction so the first pass over the
+        // ring doesn't take page faults on the hot path
+        bool prefault = true;
+    };
+
+    // A contiguous range of bytes in the ring
+    struct Region {
+        uint8_t* data;
+        size_t size;
+    };
+
+    // Returns nullptr if the memory can't be created or mapped
+    static std::unique_ptr<MirroredRingBuffer> create(size_t capacity,
+                                                      Options options) {
+        assert(capacity > 0);
+        size_t page = options.huge_pages ? huge_page_size()
+                                         : static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t size = (capacity + page - 1) / page * page;
+
+        int fd = memfd_create("mirrored_ring_buffer",
+                              MFD_CLOEXEC | (options.huge_pages ? MFD_HUGETLB : 0));
+        if (fd < 0) {
+            return nullptr;
+        }
+        if (ftruncate(fd, size) != 0) {
+            close(fd);
+            return nullptr;
+        }
+
+        // Reserve the address space for both mappings, aligned to the page
+        // size, then map the memfd over it twice
+        size_t reserved = 2 * size + page;
+        void* reservation = mmap(nullptr, reserved, PROT_NONE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                                 -1, 0);
+        if (reservation == MAP_FAILED) {
+            close(fd);
+            return nullptr;
+        }
+        uintptr_t start = reinterpret_cast<uintptr_t>(reservation);
+        uint8_t* base = reinterpret_cast<uint8_t*>((start + page - 1) / page * page);
+        int flags = MAP_SHARED | MAP_FIXED | (options.prefault ? MAP_POPULATE : 0);
+        bool mapped =
+            mmap(base, size, PROT_READ | PROT_WRITE, flags, fd, 0) == base &&
+            mmap(base + size, size, PROT_READ | PROT_WRITE, flags, fd, 0) == base + size;
+        // The mappings keep the memory alive
+        close(fd);
+        if (!mapped) {
+            munmap(reservation, reserved);
+            return nullptr;
+        }
+        // Give back the unused head and tail of the reservation
+        if (base > reservation) {
+            munmap(reservation, base - static_cast<uint8_t*>(reservation));
+        }
+        uint8_t* end = base + 2 * size;
+        uint8_t* reservation_end = static_cast<uint8_t*>(reservation) + reserved;
+        if (reservation_end > end) {
+            munmap(end, reservation_end - end);
+        }
+        return std::unique_ptr<MirroredRingBuffer>(
+            new MirroredRingBuffer(base, size));
+    }
+
+    static std::unique_ptr<MirroredRingBuffer> create(size_t capacity) {
+        return create(capacity, Options());
+    }
+
+    ~MirroredRingBuffer() {
+        munmap(base, 2 * size);
+    }
+
+    // Runs on producer thread. The writable bytes, in one piece. The read
+    // cursor is reloaded only if the cached one gives fewer than wanted bytes.
+    Region writable_region(size_t wanted = 1) {
+        uint64_t wr = producer.position;
+        if (size - (wr - producer.cached_other) < wanted) {
+            // Not enough space by the cached read cursor. Load the newest one.
+            producer.cached_other = read_position.load(std::memory_order_acquire);
+            SCHEDULE_POINT();
+        }
+        return Region { base + wr % size, size - (wr - producer.cached_other) };
+    }
+
+    // Runs on producer thread. Publish the first n bytes written into the
+    // writable region.
+    void commit_write(size_t n) {
+        assert(n <= size - (producer.position - producer.cached_other));
+        producer.position += n;
+        write_position.store(producer.position, std::memory_order_release);
+    }
+
+    // Runs on consumer thread. The readable bytes, in one piece. The write
+    // cursor is reloaded only if the cached one gives fewer than wanted bytes.
+    Region readable_region(size_t wanted = 1) {
+        uint64_t rd = consumer.position;
+        if (consumer.cached_other - rd < wanted) {
+            // Not enough data by the cached write cursor. Load the newest one.
+            consumer.cached_other = write_position.load(std::memory_order_acquire);
+            SCHEDULE_POINT();
+        }
+        return Region { base + rd % size, consumer.cached_other - rd };
+    }
+
+    // Runs on consumer thread. Release the first n bytes of the readable
+    // region back to the producer.
+    void commit_read(size_t n) {
+        assert(n <= consumer.cached_other - consumer.position);
+        consumer.position += n;
+        read_position.store(consumer.position, std::memory_order_release);
+    }
+
+    // Runs on producer thread. Copy as many bytes as fit into the buffer.
+    size_t write(const void* data, size_t count) {
+        Region w = writable_region(count);
+        size_t n = std::min(count, w.size);
+        if (n == 0) {
+            return 0;
+        }
+        std::memcpy(w.data, data, n);
+        SCHEDULE_POINT();
+        commit_write(n);
+        return n;
+    }
+
+    // Runs on consumer thread. Copy out at most count bytes.
+    size_t read(void* data, size_t count) {
+        Region r = readable_region(count);
+        size_t n = std::min(count, r.size);
+        if (n == 0) {
+            return 0;
+        }
+        std::memcpy(data, r.data, n);
+        SCHEDULE_POINT();
+        commit_read(n);
+        return n;
+    }
+
+    size_t capacity() const {
+        return size;
+    }
+
+    // Disallowed operations
+    MirroredRingBuffer(const MirroredRingBuffer& other) = delete;
+    MirroredRingBuffer(MirroredRingBuffer&& other) = delete;
+    MirroredRingBuffer& operator=(const MirroredRingBuffer& other) = delete;
+    MirroredRingBuffer& operator=(MirroredRingBuffer&& other) = delete;
+
+private:
+    MirroredRingBuffer(uint8_t* b, size_t s)
+        : base(b), size(s), write_position(0), read_position(0) {}
+
+    static size_t huge_page_size() {
+        const size_t DEFAULT = 2 * 1024 * 1024;
+        FILE* meminfo = fopen("/proc/meminfo", "r");
+        if (!meminfo) {
+            return DEFAULT;
+        }
+        char line[128];
+        size_t kb = 0;
+        while (fgets(line, sizeof(line), meminfo)) {
+            if (sscanf(line, "Hugepagesize: %zu kB", &kb) == 1) {
+                break;
+            }
+        }
+        fclose(meminfo);
+        return kb ? kb * 1024 : DEFAULT;
+    }
+
+    // The state owned by one side. position is its own cursor and
+    // cached_other is the last loaded cursor of the other side.
+    struct alignas(64) Side {
+        uint64_t position = 0;
+        uint64_t cached_other = 0;
+    };
+
+    uint8_t* const base;
+    const size_t size;
+    alignas(64) std::atomic<uint64_t> write_position; // next byte to write
+    alignas(64) std::atomic<uint64_t> read_position; // next byte to read
+    Side producer; // Only touched on producer thread
+    Side consumer; // Only touched on consumer thread
+};
+
+#endif // MirroredRingBuffer_h
\ No newline at end of file
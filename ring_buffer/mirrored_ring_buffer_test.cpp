@@ -0,0 +1,146 @@
+#include "mirrored_ring_buffer.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+const size_t NUM_OF_RECORDS = 100000;
+const size_t MAX_PAYLOAD = 300;
+
+void test_mirror_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    auto ring = MirroredRingBuffer::create(100);
+    assert(ring);
+    size_t page = sysconf(_SC_PAGESIZE);
+    std::cout << "capacity: " << ring->capacity() << std::endl;
+    assert(ring->capacity() == page);
+
+    // Move the cursors close to the end of the buffer
+    char junk[64] = {};
+    size_t offset = ring->capacity() - 10;
+    while (offset) {
+        size_t n = std::min(offset, sizeof(junk));
+        assert(ring->write(junk, n) == n);
+        assert(ring->read(junk, n) == n);
+        offset -= n;
+    }
+
+    // A 26-byte string straddles the end of the buffer but stays contiguous
+    const char* ALPHABET = "abcdefghijklmnopqrstuvwxyz";
+    assert(ring->write(ALPHABET, 26) == 26);
+    MirroredRingBuffer::Region r = ring->readable_region();
+    assert(r.size == 26);
+    assert(std::memcmp(r.data, ALPHABET, 26) == 0);
+    // The part beyond the end is the start of the buffer
+    assert(std::memcmp(r.data - (ring->capacity() - 10), ALPHABET + 10, 16) == 0);
+    std::cout << "read in place: " << std::string(reinterpret_cast<char*>(r.data), r.size)
+              << std::endl;
+    ring->commit_read(26);
+    assert(ring->readable_region().size == 0);
+    // Ask for the whole buffer so the cached read cursor is reloaded
+    assert(ring->writable_region(ring->capacity()).size == ring->capacity());
+}
+
+void test_records_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    // A one-page ring, so the records straddle the boundary very often
+    auto ring = MirroredRingBuffer::create(1);
+    assert(ring);
+    std::atomic<bool> go(false);
+
+    // A record is a 4-byte length followed by the payload, where the i-th
+    // byte of the payload of the n-th record is (n + i) % 256
+    std::thread producer([&] {
+        while (!go);
+        for (uint32_t n = 0 ; n < NUM_OF_RECORDS ; ++n) {
+            uint32_t length = n % MAX_PAYLOAD;
+            size_t size = sizeof(length) + length;
+            MirroredRingBuffer::Region w = ring->writable_region(size);
+            while (w.size < size) {
+                std::this_thread::yield();
+                w = ring->writable_region(size);
+            }
+            // Encode right in the ring memory
+            std::memcpy(w.data, &length, sizeof(length));
+            for (uint32_t i = 0 ; i < length ; ++i) {
+                w.data[sizeof(length) + i] = static_cast<uint8_t>(n + i);
+            }
+            ring->commit_write(size);
+        }
+    });
+
+    size_t straddled = 0;
+    std::thread consumer([&] {
+        while (!go);
+        uint32_t n = 0;
+        uint64_t position = 0; // Bytes consumed so far
+        while (n < NUM_OF_RECORDS) {
+            MirroredRingBuffer::Region r = ring->readable_region();
+            // Decode all the complete records right in the ring memory
+            size_t consumed = 0;
+            while (r.size - consumed >= sizeof(uint32_t)) {
+                uint32_t length;
+                std::memcpy(&length, r.data + consumed, sizeof(length));
+                if (r.size - consumed < sizeof(length) + length) {
+                    break;
+                }
+                assert(length == n % MAX_PAYLOAD);
+                const uint8_t* payload = r.data + consumed + sizeof(length);
+                for (uint32_t i = 0 ; i < length ; ++i) {
+                    assert(payload[i] == static_cast<uint8_t>(n + i));
+                }
+                size_t size = sizeof(length) + length;
+                if ((position + consumed) % ring->capacity() + size >
+                    ring->capacity()) {
+                    ++straddled;
+                }
+                consumed += size;
+                ++n;
+            }
+            if (consumed == 0) {
+                std::this_thread::yield();
+            }
+            ring->commit_read(consumed);
+            position += consumed;
+        }
+    });
+
+    go = true;
+    producer.join();
+    consumer.join();
+    std::cout << NUM_OF_RECORDS << " records decoded in place, " << straddled
+              << " of them straddle the end of the buffer" << std::endl;
+    assert(straddled > 0);
+}
+
+void test_huge_pages_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    MirroredRingBuffer::Options options;
+    options.huge_pages = true;
+    auto ring = MirroredRingBuffer::create(1, options);
+    if (!ring) {
+        std::cout << "No huge pages available" << std::endl;
+        return;
+    }
+    std::cout << "capacity: " << ring->capacity() << std::endl;
+    assert(ring->capacity() > static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+    uint64_t v = 42;
+    assert(ring->write(&v, sizeof(v)) == sizeof(v));
+    v = 0;
+    assert(ring->read(&v, sizeof(v)) == sizeof(v) && v == 42);
+}
+
+int main() {
+    test_mirror_example();
+    test_records_example();
+    test_huge_pages_example();
+    return 0;
+}
@@ -0,0 +1,83 @@
+#ifndef OverwriteRingBuffer_h
+#define OverwriteRingBuffer_h
+
+#include "broadcast_ring_buffer.h"
+
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+// OverwriteSPSCRingBuffer
+//     A thread-safe single-producer-single-consumer circular buffer that
+//     keeps the newest data when it's full. SPSCRingBuffer's write() drops
+//     the new data when the consumer falls behind. This one always accepts
+//     it and drops the oldest instead, which is what telemetry or a stream of
+//     quotes needs, and tells the consumer how many elements it has lost.
+//
+//     The producer can't move SPSCRingBuffer's read-cursor from under the
+//     consumer, so this is a BroadcastRingBuffer with a single consumer in
+//     the Lossy policy: each slot has a sequence number, and the consumer
+//     uses it to detect that it has been lapped and to skip to the oldest
+//     element left. T must be trivially copyable, and the capacity is rounded
+//     up to a power of two.
+//
+// Usage:
+//     OverwriteSPSCRingBuffer<int> ring(4);
+//     ring.write(1); // Producer thread. Always succeeds
+//     std::vector<int> data = ring.read_all(); // Consumer thread
+//     uint64_t lost = ring.lost(); // Consumer thread
+template<class T>
+class OverwriteSPSCRingBuffer final {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "The slots are overwritten with raw copies");
+public:
+    explicit OverwriteSPSCRingBuffer(size_t capacity)
+        : ring(capacity, 1) {}
+
+    ~OverwriteSPSCRingBuffer() = default;
+
+    // Runs on producer thread. Always writes the data.
+    size_t write(const T& data) {
+        return ring.write(data);
+    }
+
+    // Runs on producer thread. Always writes all the data, though only the
+    // last capacity() elements are left if there are more.
+    size_t write_all(const std::vector<T>& data) {
+        return ring.write_all(data);
+    }
+
+    // Runs on consumer thread. The oldest element not overwritten yet.
+    std::optional<T> read() {
+        return ring.read(CONSUMER);
+    }
+
+    // Runs on consumer thread
+    std::vector<T> read_all() {
+        return ring.read_all(CONSUMER);
+    }
+
+    // Runs on consumer thread. The number of elements overwritten before the
+    // consumer read them, so far.
+    uint64_t lost() const {
+        return ring.lost(CONSUMER);
+    }
+
+    size_t capacity() const {
+        return ring.capacity();
+    }
+
+    // Disallowed operations
+    OverwriteSPSCRingBuffer(const OverwriteSPSCRingBuffer& other) = delete;
+    OverwriteSPSCRingBuffer(OverwriteSPSCRingBuffer&& other) = delete;
+    OverwriteSPSCRingBuffer& operator=(const OverwriteSPSCRingBuffer& other) = delete;
+    OverwriteSPSCRingBuffer& operator=(OverwriteSPSCRingBuffer&& other) = delete;
+
+private:
+    static const size_t CONSUMER = 0;
+
+    BroadcastRingBuffer<T, BroadcastPolicy::Lossy> ring;
+};
+
+#endif // OverwriteRingBuffer_h
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include "overwrite_ring_buffer.h"
+#include "ring_buffer.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+const uint64_t NUM_OF_MESSAGES = 100000;
+
+void test_overwrite_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    // SPSCRingBuffer keeps the oldest data when it's full
+    SPSCRingBuffer<int> drop_newest(4);
+    OverwriteSPSCRingBuffer<int> drop_oldest(4);
+    for (int i = 0 ; i < 6 ; ++i) {
+        drop_newest.write(i);
+        assert(drop_oldest.write(i) == 1);
+    }
+    assert(drop_newest.read_all() == std::vector<int>({ 0, 1, 2, 3 }));
+    assert(drop_oldest.read_all() == std::vector<int>({ 2, 3, 4, 5 }));
+    assert(drop_oldest.lost() == 2);
+
+    assert(!drop_oldest.read());
+    drop_oldest.write_all({ 6, 7, 8, 9, 10, 11, 12 });
+    std::optional<int> v = drop_oldest.read();
+    assert(v && *v == 9);
+    assert(drop_oldest.lost() == 5);
+    std::cout << "lost " << drop_oldest.lost() << std::endl;
+}
+
+void test_slow_consumer_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    OverwriteSPSCRingBuffer<uint64_t> ring(64);
+    std::atomic<bool> done(false);
+
+    std::thread producer([&] {
+        for (uint64_t i = 0 ; i < NUM_OF_MESSAGES ; ++i) {
+            ring.write(i);
+        }
+        done = true;
+    });
+
+    // The consumer sees an increasing subsequence ending at the newest value,
+    // and whatever it doesn't see is counted as lost
+    uint64_t received = 0;
+    std::optional<uint64_t> last;
+    while (true) {
+        bool finished = done;
+        std::vector<uint64_t> data = ring.read_all();
+        for (uint64_t v: data) {
+            assert(!last || v > *last);
+            last = v;
+        }
+        received += data.size();
+        if (finished && data.empty()) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
+    }
+    producer.join();
+    assert(last && *last == NUM_OF_MESSAGES - 1);
+    assert(received + ring.lost() == NUM_OF_MESSAGES);
+    std::cout << "received " << received << ", lost " << ring.lost()
+              << std::endl;
+}
+
+int main() {
+    test_overwrite_example();
+    test_slow_consumer_example();
+    return 0;
+}
\ No newline at end of file
@@ -7,9 +7,16 @@
 #include <cstring>
 #include <limits>
 #include <optional>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+// A hook between the atomic operations for the stress tests to perturb the
+// thread schedule. See stress/stress.h.
+#ifndef SCHEDULE_POINT
+#define SCHEDULE_POINT()
+#endif
+
 // SPSCRingBuffer
 //     A thread-safe single-producer-single-consumer circular buffer class.
 //     The implementation has a read-cursor and a write-cursor to split up its
@@ -71,43 +78,32 @@ public:
 
     ~SPSCRingBuffer() = default;
 
-    // Runs on producer thread
+    // Runs on producer thread. The one element version of write(...) below,
+    // without its two part copy.
     size_t write(const T& data) {
-        return write(&data, 1);
-    }
-
-    // Runs on producer thread
-    size_t write_all(const std::vector<T>& data) {
-        return write(data.data(), data.size());
-    }
+        size_t rd_idx = read_index.load(std::memory_order::memory_order_acquire);
+        size_t wr_idx = write_index.load(std::memory_order::memory_order_relaxed);
+        SCHEDULE_POINT();
 
-    // Runs on consumer thread
-    std::optional<T> read() {
-        std::vector<T> data = read(1);
-        if (data.empty()) {
-            return std::nullopt;
+        if (is_full(rd_idx, wr_idx)) {
+            return 0;
         }
-        return std::optional<T>(std::move(data[0]));
-    }
 
-    // Runs on consumer thread
-    std::vector<T> read_all() {
-        return read(capacity());
-    }
+        copy(buffer.data() + wr_idx, &data, 1);
+        SCHEDULE_POINT();
 
-    size_t capacity() const {
-        assert(buffer.size() > 0);
-        return buffer.size() - 1;
+        write_index.store(advance_index(wr_idx, 1),
+                          std::memory_order::memory_order_release);
+        return 1;
     }
 
-    size_t writable_capacity() const {
-        size_t rd_idx = read_index.load(std::memory_order::memory_order_relaxed);
-        size_t wr_idx = write_index.load(std::memory_order::memory_order_relaxed);
-        return writable(rd_idx, wr_idx);
+    // Runs on producer thread
+    size_t write_all(const std::vector<T>& data) {
+        return write(data.data(), data.size());
     }
 
-private:
-    // Runs on producer thread
+    // Runs on producer thread. Writes as many of the count elements at data
+    // as fit, without a std::vector to hold them.
     size_t write(const T* data, size_t count) {
         // Transitive Synchronication with Acquire-Release Ordering:
         //     If read_index.store(...) has been called by read(...) on
@@ -122,6 +118,7 @@ private:
         //     write_index, the smaller data we can read.
         size_t rd_idx = read_index.load(std::memory_order::memory_order_acquire);
         size_t wr_idx = write_index.load(std::memory_order::memory_order_relaxed);
+        SCHEDULE_POINT();
 
         if (is_full(rd_idx, wr_idx) || count == 0) {
             return 0;
@@ -139,6 +136,7 @@ private:
         // second part: from the beginning of the buffer
         size_t second_part = num - first_part;
         copy(buffer.data(), data + first_part, second_part);
+        SCHEDULE_POINT();
 
         // Update write_index
         write_index.store(advance_index(wr_idx, num),
@@ -147,6 +145,39 @@ private:
         return num;
     }
 
+    // Runs on consumer thread
+    std::optional<T> read() {
+        std::vector<T> data = read(1);
+        if (data.empty()) {
+            return std::nullopt;
+        }
+        return std::optional<T>(std::move(data[0]));
+    }
+
+    // Runs on consumer thread
+    std::vector<T> read_all() {
+        return read(capacity());
+    }
+
+    size_t capacity() const {
+        assert(buffer.size() > 0);
+        return buffer.size() - 1;
+    }
+
+    // Only a hint while the producer is writing
+    bool empty() const {
+        size_t wr_idx = write_index.load(std::memory_order::memory_order_acquire);
+        size_t rd_idx = read_index.load(std::memory_order::memory_order_relaxed);
+        return is_empty(rd_idx, wr_idx);
+    }
+
+    size_t writable_capacity() const {
+        size_t rd_idx = read_index.load(std::memory_order::memory_order_relaxed);
+        size_t wr_idx = write_index.load(std::memory_order::memory_order_relaxed);
+        return writable(rd_idx, wr_idx);
+    }
+
+private:
     // Runs on consumer thread
     std::vector<T> read(size_t count) {
         // Transitive Synchronication with Acquire-Release Ordering:
@@ -162,6 +193,7 @@ private:
         //     write_index and read_index, the smaller data we can read.
         size_t wr_idx = write_index.load(std::memory_order::memory_order_acquire);
         size_t rd_idx = read_index.load(std::memory_order::memory_order_relaxed);
+        SCHEDULE_POINT();
 
         if (is_empty(rd_idx, wr_idx) || count == 0) {
             return {};
@@ -179,6 +211,7 @@ private:
         // second part: from the beginning of the buffer
         size_t second_part = num - first_part;
         copy(values.data() + first_part, buffer.data(), second_part);
+        SCHEDULE_POINT();
 
         // Update read_index
         read_index.store(advance_index(rd_idx, num),
@@ -187,10 +220,13 @@ private:
         return values;
     }
 
+    // A subtraction instead of a modulo: the division costs more than the
+    // rest of a small write
     size_t advance_index(size_t idx, size_t advancement) const {
         assert(idx < buffer.size());
         assert(advancement <= capacity());
-        return (idx + advancement) % buffer.size();
+        size_t next = idx + advancement;
+        return next >= buffer.size() ? next - buffer.size() : next;
     }
 
     size_t writable(size_t rd_idx, size_t wr_idx) const {
@@ -209,13 +245,19 @@ private:
     }
 
     bool is_full(size_t rd_idx, size_t wr_idx) const {
-        return (wr_idx + 1) % buffer.size() == rd_idx;
+        return advance_index(wr_idx, 1) == rd_idx;
     }
 
     static inline void copy(T* dst, const T* src, size_t elem) {
         // Make sure destination and source isn't overlapped
         assert(dst + elem <= src || src + elem <= dst);
-        std::memcpy(dst, src, elem * sizeof(T));
+        // Copying bytes of a non-trivially-copyable type, e.g., std::string,
+        // makes two objects own the same resources
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            std::memcpy(dst, src, elem * sizeof(T));
+        } else {
+            std::copy(src, src + elem, dst);
+        }
     }
 
     std::vector<T> buffer;
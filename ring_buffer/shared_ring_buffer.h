@@ -0,0 +1,504 @@
+#ifndef SharedRingBuffer_h
+#define SharedRingBuffer_h
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+
+// A hook between the atomic operations for the stress tests to perturb the
+// thread schedule. See stress/stress.h.
+#ifndef SCHEDULE_POINT
+#define SCHEDULE_POINT()
+#endif
+
+// SharedSPSCRingBuffer
+//     A single-producer-single-consumer circular buffer living in shared
+//     memory, so the producer and the consumer can be different processes.
+//     The elements are copied into the shared slots once and read from there
+//     once, without any syscall on the data path.
+//
+//     The segment is either a named POSIX shared memory object (create() and
+//     attach() by name), or an anonymous memfd (create_anonymous() and
+//     attach_fd()) whose fd is passed to the peer by fork() or SCM_RIGHTS.
+//     It has a fixed layout, checked by a magic number, a version and the
+//     element size on attach:
+//
+//     +--------------------------+ 0
+//     | Header                   |
+//     |   magic, version, sizes  |
+//     |   producer: cursor, owner| (own cache line)
+//     |   consumer: cursor, owner| (own cache line)
+//     |   futex words            | (own cache line)
+//     +--------------------------+ sizeof(Header)
+//     | slot 0                   |
+//     | ...                      |
+//     | slot capacity - 1        |
+//     +--------------------------+
+//
+//     The cursors are monotonic 64-bit element counters rather than pointers,
+//     so the segment can be mapped at different addresses in each process.
+//     Same as SPSCRingBuffer, they are published with acquire-release
+//     ordering, and the element type must be trivially copyable since the
+//     bytes are shared between processes.
+//
+//     Crash recovery: A process claims its role by storing its pid in the
+//     header, with the low bits of its start time so a new process reusing a
+//     crashed one's pid isn't taken for it, and gives the role up on
+//     destruction. A cursor is only advanced after
+//     the slots are fully written or read, so a peer crashing at any point
+//     leaves a consistent ring behind. peer_crashed() tells the survivor the
+//     peer's process is gone, and a new process can take the role over by
+//     attach(), even if the crashed one never gave it up. A new producer
+//     continues after the last published element. A new consumer continues
+//     from the last committed read, so the elements the crashed one read but
+//     didn't commit are delivered again.
+//
+//     Waking up: wait_readable() and wait_writable() sleep on futex words in
+//     the segment. The other side only issues FUTEX_WAKE when someone sleeps,
+//     so the data path stays syscall-free when nobody waits.
+//
+// Usage:
+//     // Process A
+//     auto ring = SharedSPSCRingBuffer<Message>::create(
+//         "/my_ring", 1024, SharedSPSCRingBuffer<Message>::Role::Producer);
+//     ring->write(message);
+//
+//     // Process B
+//     auto ring = SharedSPSCRingBuffer<Message>::attach(
+//         "/my_ring", SharedSPSCRingBuffer<Message>::Role::Consumer);
+//     if (ring->wait_readable(std::chrono::milliseconds(100))) {
+//         std::optional<Message> m = ring->read();
+//     }
+//
+//     // Either one, when both are done
+//     SharedSPSCRingBuffer<Message>::unlink("/my_ring");
+//
+//     An instance belongs to the process creating it. A forked child should
+//     attach_fd(parent_ring->fd(), ...) rather than use the parent's instance.
+template<class T>
+class SharedSPSCRingBuffer final {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "The elements are shared as bytes between processes");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                  std::atomic<uint32_t>::is_always_lock_free,
+                  "The atomics in shared memory must be address-free");
+public:
+    static constexpr uint64_t MAGIC = 0x474e495253505358; // "XSPSRING"
+    static constexpr uint32_t VERSION = 2;
+
+    enum class Role { Producer, Consumer };
+
+    // Create a named segment and take the role. Returns nullptr if the name
+    // exists or the segment can't be created.
+    static std::unique_ptr<SharedSPSCRingBuffer> create(const std::string& name,
+                                                        size_t capacity,
+                                                        Role role) {
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) {
+            return nullptr;
+        }
+        auto ring = initialize(fd, capacity, role);
+        if (!ring) {
+            shm_unlink(name.c_str());
+        }
+        return ring;
+    }
+
+    // Attach to a named segment and take the role. Returns nullptr if the
+    // segment doesn't exist, isn't initialized yet, doesn't match, or the
+    // role is taken by a live process.
+    static std::unique_ptr<SharedSPSCRingBuffer> attach(const std::string& name,
+                                                        Role role) {
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0) {
+            return nullptr;
+        }
+        return map(fd, role);
+    }
+
+    static void unlink(const std::string& name) {
+        shm_unlink(name.c_str());
+    }
+
+    // Create an anonymous segment and take the role. Pass fd() to the peer
+    // process so it can attach_fd(...).
+    static std::unique_ptr<SharedSPSCRingBuffer> create_anonymous(size_t capacity,
+                                                                  Role role) {
+        int fd = memfd_create("shared_spsc_ring_buffer", 0);
+        if (fd < 0) {
+            return nullptr;
+        }
+        return initialize(fd, capacity, role);
+    }
+
+    // Attach to the segment behind fd, which is dup'ed, and take the role
+    static std::unique_ptr<SharedSPSCRingBuffer> attach_fd(int fd, Role role) {
+        int own = dup(fd);
+        if (own < 0) {
+            return nullptr;
+        }
+        return map(own, role);
+    }
+
+    ~SharedSPSCRingBuffer() {
+        // Give up the role so another process can take it right away
+        uint64_t owner = self;
+        own_side().owner.compare_exchange_strong(owner, 0,
+                                                 std::memory_order_release);
+        munmap(header, mapped_size);
+        close(segment_fd);
+    }
+
+    int fd() const {
+        return segment_fd;
+    }
+
+    // Runs on producer process
+    size_t write(const T& data) {
+        return write(&data, 1);
+    }
+
+    // Runs on producer process. Returns how many elements are written.
+    size_t write(const T* data, size_t count) {
+        assert(role == Role::Producer);
+        uint64_t wr = header->producer.cursor.load(std::memory_order_relaxed);
+        uint64_t rd = header->consumer.cursor.load(std::memory_order_acquire);
+        SCHEDULE_POINT();
+        size_t num = std::min<uint64_t>(count, capacity - (wr - rd));
+        if (num == 0) {
+            return 0;
+        }
+        // first part: from wr to the end of the slots
+        size_t first_part = std::min<uint64_t>(capacity - wr % capacity, num);
+        std::memcpy(slots + wr % capacity, data, first_part * sizeof(T));
+        // second part: from the beginning of the slots
+        std::memcpy(slots, data + first_part, (num - first_part) * sizeof(T));
+        SCHEDULE_POINT();
+        header->producer.cursor.store(wr + num, std::memory_order_release);
+        wake(header->readable, header->readable_waiters);
+        return num;
+    }
+
+    // Runs on consumer process
+    std::optional<T> read() {
+        T data;
+        if (read(&data, 1) == 0) {
+            return std::nullopt;
+        }
+        return data;
+    }
+
+    // Runs on consumer process. Returns how many elements are read.
+    size_t read(T* data, size_t count) {
+        assert(role == Role::Consumer);
+        uint64_t rd = header->consumer.cursor.load(std::memory_order_relaxed);
+        uint64_t wr = header->producer.cursor.load(std::memory_order_acquire);
+        SCHEDULE_POINT();
+        size_t num = std::min<uint64_t>(count, wr - rd);
+        if (num == 0) {
+            return 0;
+        }
+        size_t first_part = std::min<uint64_t>(capacity - rd % capacity, num);
+        std::memcpy(data, slots + rd % capacity, first_part * sizeof(T));
+        std::memcpy(data + first_part, slots, (num - first_part) * sizeof(T));
+        SCHEDULE_POINT();
+        header->consumer.cursor.store(rd + num, std::memory_order_release);
+        wake(header->writable, header->writable_waiters);
+        return num;
+    }
+
+    // Runs on consumer process. Block until there is data to read or the
+    // timeout expires. Returns true if there is data.
+    bool wait_readable(std::chrono::nanoseconds timeout) {
+        assert(role == Role::Consumer);
+        return wait(header->readable, header->readable_waiters, timeout, [this] {
+            return header->producer.cursor.load(std::memory_order_acquire) !=
+                   header->consumer.cursor.load(std::memory_order_relaxed);
+        });
+    }
+
+    // Runs on producer process. Block until there is space to write or the
+    // timeout expires. Returns true if there is space.
+    bool wait_writable(std::chrono::nanoseconds timeout) {
+        assert(role == Role::Producer);
+        return wait(header->writable, header->writable_waiters, timeout, [this] {
+            return header->producer.cursor.load(std::memory_order_relaxed) -
+                   header->consumer.cursor.load(std::memory_order_acquire) <
+                   capacity;
+        });
+    }
+
+    // True if the peer took its role and its process is gone without giving
+    // the role up. Another process can then attach() to take over. A zombie
+    // process still counts as alive until its parent reaps it.
+    bool peer_crashed() const {
+        uint64_t owner = peer_side().owner.load(std::memory_order_acquire);
+        return owner != 0 && !alive(owner);
+    }
+
+    // True if a live process holds the peer role
+    bool peer_attached() const {
+        uint64_t owner = peer_side().owner.load(std::memory_order_acquire);
+        return owner != 0 && alive(owner);
+    }
+
+    size_t size() const {
+        return capacity;
+    }
+
+    // The processes asleep in wait_readable(...) or wait_writable(...)
+    uint32_t waiters() const {
+        return header->readable_waiters.load(std::memory_order_relaxed) +
+               header->writable_waiters.load(std::memory_order_relaxed);
+    }
+
+    // Disallowed operations
+    SharedSPSCRingBuffer(const SharedSPSCRingBuffer& other) = delete;
+    SharedSPSCRingBuffer(SharedSPSCRingBuffer&& other) = delete;
+    SharedSPSCRingBuffer& operator=(const SharedSPSCRingBuffer& other) = delete;
+    SharedSPSCRingBuffer& operator=(SharedSPSCRingBuffer&& other) = delete;
+
+private:
+    struct alignas(64) Side {
+        std::atomic<uint64_t> cursor; // next element to write or read
+        // The process having the role, or 0: the low 32 bits of its start
+        // time above its pid. See owner_of(...).
+        std::atomic<uint64_t> owner;
+    };
+
+    // The fixed layout at the start of the segment. Bump VERSION on change.
+    struct Header {
+        std::atomic<uint64_t> magic; // Stored last, when the header is ready
+        uint32_t version;
+        uint32_t header_size;
+        uint64_t element_size;
+        uint64_t capacity;
+        Side producer;
+        Side consumer;
+        // Futex words bumped when the ring becomes readable or writable, and
+        // the numbers of the waiters sleeping on them
+        alignas(64) std::atomic<uint32_t> readable;
+        std::atomic<uint32_t> readable_waiters;
+        alignas(64) std::atomic<uint32_t> writable;
+        std::atomic<uint32_t> writable_waiters;
+    };
+
+    static size_t segment_size(size_t capacity) {
+        return sizeof(Header) + capacity * sizeof(T);
+    }
+
+    static std::unique_ptr<SharedSPSCRingBuffer> initialize(int fd,
+                                                            size_t capacity,
+                                                            Role role) {
+        assert(capacity > 0);
+        if (ftruncate(fd, segment_size(capacity)) != 0) {
+            close(fd);
+            return nullptr;
+        }
+        void* memory = mmap(nullptr, segment_size(capacity),
+                            PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED) {
+            close(fd);
+            return nullptr;
+        }
+        // ftruncate zero-fills the segment, which is a valid initial state
+        // of all the atomics. Write the description and publish it by magic.
+        Header* h = static_cast<Header*>(memory);
+        h->version = VERSION;
+        h->header_size = sizeof(Header);
+        h->element_size = sizeof(T);
+        h->capacity = capacity;
+        h->magic.store(MAGIC, std::memory_order_release);
+        munmap(memory, segment_size(capacity));
+        return map(fd, role);
+    }
+
+    // Takes the ownership of fd
+    static std::unique_ptr<SharedSPSCRingBuffer> map(int fd, Role role) {
+        struct stat st;
+        if (fstat(fd, &st) != 0 ||
+            static_cast<size_t>(st.st_size) < sizeof(Header)) {
+            close(fd);
+            return nullptr;
+        }
+        void* memory = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED) {
+            close(fd);
+            return nullptr;
+        }
+        Header* h = static_cast<Header*>(memory);
+        // The header isn't trusted: a capacity so large segment_size(...)
+        // wraps around would pass the size check and index out of the map
+        bool valid = h->magic.load(std::memory_order_acquire) == MAGIC &&
+                     h->version == VERSION &&
+                     h->header_size == sizeof(Header) &&
+                     h->element_size == sizeof(T) &&
+                     h->capacity > 0 &&
+                     h->capacity <= (SIZE_MAX - sizeof(Header)) / sizeof(T) &&
+                     static_cast<size_t>(st.st_size) >= segment_size(h->capacity);
+        if (!valid) {
+            munmap(memory, st.st_size);
+            close(fd);
+            return nullptr;
+        }
+        std::unique_ptr<SharedSPSCRingBuffer> ring(
+            new SharedSPSCRingBuffer(fd, h, st.st_size, role));
+        if (!ring->claim()) {
+            return nullptr;
+        }
+        return ring;
+    }
+
+    SharedSPSCRingBuffer(int fd, Header* h, size_t size, Role r)
+        : segment_fd(fd)
+        , header(h)
+        , slots(reinterpret_cast<T*>(reinterpret_cast<uint8_t*>(h) + sizeof(Header)))
+        , mapped_size(size)
+        , capacity(h->capacity)
+        , role(r)
+        , self(owner_of(getpid())) {}
+
+    // Take the role if nobody, or only a dead process, has it
+    bool claim() {
+        std::atomic<uint64_t>& owner = own_side().owner;
+        uint64_t holder = owner.load(std::memory_order_acquire);
+        while (holder == 0 || !alive(holder)) {
+            if (owner.compare_exchange_weak(holder, self,
+                                            std::memory_order_acq_rel)) {
+                if (holder != 0) {
+                    // Only the owner of the role waits on its side. A dead
+                    // one may have been asleep and never undone its count,
+                    // which would make every write() or read() of the peer
+                    // issue a FUTEX_WAKE from now on.
+                    own_waiters().store(0, std::memory_order_relaxed);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The pid alone may be reused by a new process once the old one is
+    // reaped, but not with the same start time
+    static uint64_t owner_of(pid_t pid) {
+        return (start_time(pid) & 0xffffffff) << 32 | static_cast<uint32_t>(pid);
+    }
+
+    static bool alive(uint64_t owner) {
+        pid_t pid = static_cast<pid_t>(owner & 0xffffffff);
+        if (kill(pid, 0) != 0 && errno != EPERM) {
+            return false;
+        }
+        // Without procfs, e.g., the peer in another pid namespace, both sides
+        // record a start time of 0 and only the pid is checked
+        return owner_of(pid) == owner;
+    }
+
+    // The start time of pid in clock ticks after boot, the 22nd field of
+    // /proc/<pid>/stat, or 0 if it can't be read
+    static uint64_t start_time(pid_t pid) {
+        char path[32];
+        snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return 0;
+        }
+        char buffer[1024];
+        ssize_t n = ::read(fd, buffer, sizeof(buffer) - 1);
+        close(fd);
+        if (n <= 0) {
+            return 0;
+        }
+        buffer[n] = '\0';
+        // The 2nd field, the command name in parentheses, may contain spaces
+        // and parentheses itself, so count the fields after the last ')'
+        const char* field = strrchr(buffer, ')');
+        for (int i = 2 ; field && i < 22 ; ++i) {
+            field = strchr(field + 1, ' ');
+        }
+        return field ? strtoull(field + 1, nullptr, 10) : 0;
+    }
+
+    Side& own_side() const {
+        return role == Role::Producer ? header->producer : header->consumer;
+    }
+
+    Side& peer_side() const {
+        return role == Role::Producer ? header->consumer : header->producer;
+    }
+
+    // The waiters of wait_writable(...) on producer process, or of
+    // wait_readable(...) on consumer process
+    std::atomic<uint32_t>& own_waiters() const {
+        return role == Role::Producer ? header->writable_waiters
+                                      : header->readable_waiters;
+    }
+
+    // The futex words are shared between processes, so no FUTEX_PRIVATE_FLAG
+    static void wake(std::atomic<uint32_t>& word,
+                     std::atomic<uint32_t>& waiters) {
+        // Order the cursor store before loading waiters. Pairs with the
+        // increment of waiters in wait(...).
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        word.fetch_add(1, std::memory_order_release);
+        syscall(SYS_futex, &word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+
+    template<class Ready>
+    static bool wait(std::atomic<uint32_t>& word,
+                     std::atomic<uint32_t>& waiters,
+                     std::chrono::nanoseconds timeout, Ready ready) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!ready()) {
+            auto left = deadline - std::chrono::steady_clock::now();
+            if (left <= std::chrono::nanoseconds(0)) {
+                return false;
+            }
+            waiters.fetch_add(1, std::memory_order_seq_cst);
+            uint32_t seen = word.load(std::memory_order_acquire);
+            if (!ready()) {
+                auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+                timespec ts = { static_cast<time_t>(ns / 1000000000),
+                                static_cast<long>(ns % 1000000000) };
+                // Returns right away if word isn't seen anymore
+                syscall(SYS_futex, &word, FUTEX_WAIT, seen, &ts, nullptr, 0);
+            }
+            waiters.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    const int segment_fd;
+    Header* const header;
+    T* const slots;
+    const size_t mapped_size;
+    const uint64_t capacity;
+    const Role role;
+    const uint64_t self; // owner_of(getpid())
+};
+
+#endif // SharedRingBuffer_h
\ No newline at end of file
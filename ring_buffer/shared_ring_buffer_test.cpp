@@ -0,0 +1,180 @@
+#include "shared_ring_buffer.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+typedef SharedSPSCRingBuffer<uint64_t> Ring;
+
+const size_t NUM_OF_MESSAGES = 1000000;
+const std::chrono::seconds TIMEOUT(5);
+
+// Run f in a child process and return its pid
+template<class F>
+pid_t spawn(F f) {
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        f();
+        _exit(EXIT_SUCCESS);
+    }
+    return pid;
+}
+
+bool exited_normally(pid_t pid) {
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+// Write [from, to) in order, sleeping on the futex when the ring is full
+void produce(Ring& ring, uint64_t from, uint64_t to) {
+    uint64_t batch[64];
+    while (from < to) {
+        size_t n = std::min<uint64_t>(to - from, 64);
+        for (size_t i = 0 ; i < n ; ++i) {
+            batch[i] = from + i;
+        }
+        size_t written = ring.write(batch, n);
+        if (written == 0) {
+            ring.wait_writable(TIMEOUT);
+        }
+        from += written;
+    }
+}
+
+void test_named_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    const std::string NAME = "/shared_ring_buffer_test_" + std::to_string(getpid());
+    auto ring = Ring::create(NAME, 1024, Ring::Role::Consumer);
+    assert(ring);
+    // A wrong element type is rejected
+    typedef SharedSPSCRingBuffer<uint32_t> OtherRing;
+    assert(!OtherRing::attach(NAME, OtherRing::Role::Producer));
+    // The consumer role is taken by this live process
+    assert(!Ring::attach(NAME, Ring::Role::Consumer));
+
+    pid_t producer = spawn([&] {
+        auto ring = Ring::attach(NAME, Ring::Role::Producer);
+        assert(ring);
+        produce(*ring, 0, NUM_OF_MESSAGES);
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t expected = 0;
+    uint64_t batch[64];
+    while (expected < NUM_OF_MESSAGES) {
+        size_t n = ring->read(batch, 64);
+        if (n == 0) {
+            assert(ring->wait_readable(TIMEOUT));
+        }
+        for (size_t i = 0 ; i < n ; ++i) {
+            assert(batch[i] == expected++);
+        }
+    }
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    std::cout << NUM_OF_MESSAGES << " messages across processes in "
+              << seconds << "s" << std::endl;
+
+    assert(exited_normally(producer));
+    assert(!ring->peer_attached()); // The producer gave its role up
+    assert(!ring->peer_crashed());
+    Ring::unlink(NAME);
+}
+
+void test_crash_recovery_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    const uint64_t HALF = 1000;
+    auto ring = Ring::create_anonymous(4 * HALF, Ring::Role::Consumer);
+    assert(ring);
+
+    // The first producer writes half of the data and dies without cleanup
+    pid_t crashed = spawn([&] {
+        auto producer = Ring::attach_fd(ring->fd(), Ring::Role::Producer);
+        assert(producer);
+        produce(*producer, 0, HALF);
+        _exit(EXIT_FAILURE); // Skip the destructors as if it crashed
+    });
+    assert(!exited_normally(crashed));
+    assert(ring->peer_crashed());
+    std::cout << "producer " << crashed << " crashed" << std::endl;
+
+    // A new producer takes the role over and continues
+    pid_t successor = spawn([&] {
+        auto producer = Ring::attach_fd(ring->fd(), Ring::Role::Producer);
+        assert(producer);
+        produce(*producer, HALF, 2 * HALF);
+    });
+    assert(exited_normally(successor));
+    assert(!ring->peer_crashed());
+
+    for (uint64_t expected = 0 ; expected < 2 * HALF ; ++expected) {
+        std::optional<uint64_t> v = ring->read();
+        assert(v && *v == expected);
+    }
+    assert(!ring->read());
+    std::cout << "all data from both producers received" << std::endl;
+}
+
+void test_crashed_waiter_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    // A consumer is killed asleep in wait_readable(...), leaving its count
+    // of waiters behind
+    auto ring = Ring::create_anonymous(16, Ring::Role::Producer);
+    assert(ring);
+    pid_t crashed = spawn([&] {
+        auto consumer = Ring::attach_fd(ring->fd(), Ring::Role::Consumer);
+        assert(consumer);
+        consumer->wait_readable(std::chrono::seconds(60));
+    });
+    while (ring->waiters() == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    kill(crashed, SIGKILL);
+    assert(!exited_normally(crashed));
+    assert(ring->peer_crashed());
+    assert(ring->waiters() == 1);
+
+    // The new consumer resets it when it takes the role over
+    pid_t successor = spawn([&] {
+        auto consumer = Ring::attach_fd(ring->fd(), Ring::Role::Consumer);
+        assert(consumer);
+        assert(consumer->waiters() == 0);
+    });
+    assert(exited_normally(successor));
+    std::cout << "waiters after the takeover: " << ring->waiters() << std::endl;
+    assert(ring->waiters() == 0);
+}
+
+void test_corrupted_header_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    auto ring = Ring::create_anonymous(16, Ring::Role::Producer);
+    assert(ring);
+    // A capacity whose segment size wraps around to sizeof(Header). It's at
+    // offset 24 of the layout: magic, version, header_size, element_size.
+    const uint64_t capacity = UINT64_MAX / sizeof(uint64_t) + 1;
+    assert(pwrite(ring->fd(), &capacity, sizeof(capacity), 24) ==
+           sizeof(capacity));
+    assert(!Ring::attach_fd(ring->fd(), Ring::Role::Consumer));
+}
+
+int main() {
+    test_named_example();
+    test_crash_recovery_example();
+    test_crashed_waiter_example();
+    test_corrupted_header_example();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,372 @@
+#ifndef Stress_h
+#define Stress_h
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Tools to stress the concurrent primitives and check the results:
+//
+// - Schedule perturbation: The lock-free primitives call SCHEDULE_POINT()
+//   between their atomic operations. It's a no-op by default. Define
+//   STRESS_PERTURB and include this file before the primitives to make every
+//   schedule point randomly yield, spin or sleep a bit, so the stress tests
+//   explore far more interleavings than the "natural" ones. The choices come
+//   from a per-thread generator derived from stress_seed() and a thread index,
+//   so a failing seed can be replayed, although the OS scheduler still adds
+//   its own randomness. The stress threads set their index by
+//   set_stress_thread(...). The other threads, e.g., the workers of a task
+//   queue, are numbered in the order they reach their first schedule point,
+//   which is only stable if they start one by one.
+//
+// - History recording: OperationHistory records the invocation and response
+//   times of every operation with the steady clock, which needs no extra
+//   synchronization between the threads. Adding a shared atomic counter here
+//   would insert fences that hide exactly the weak-ordering bugs we look for.
+//
+// - Linearizability checking: LinearizabilityChecker<Model> searches for a
+//   sequential order of the recorded operations that respects their real-time
+//   order and is accepted by a sequential Model, by the Wing & Gong algorithm
+//   with Lowe's memoization [1]. The search is exponential in the worst case,
+//   so keep the histories short (hundreds of operations) and run many rounds.
+//
+// - The stress tests in this folder are also meant to be built with
+//   ThreadSanitizer, see the tsan target in the makefile.
+//
+// [1] Gavin Lowe, Testing for linearizability, 2017
+
+// Per-thread random generator (xorshift64*) for the perturbation and for the
+// stress tests themselves
+class StressRandom final {
+public:
+    explicit StressRandom(uint64_t seed): state(seed ? seed : 0x9e3779b97f4a7c15) {}
+
+    uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545f4914f6cdd1d;
+    }
+
+    // A number in [0, n)
+    size_t below(size_t n) {
+        assert(n > 0);
+        return next() % n;
+    }
+
+private:
+    uint64_t state;
+};
+
+// The seed of the whole run. Taken from STRESS_SEED environment variable if
+// it's set, or from the clock otherwise.
+inline uint64_t stress_seed() {
+    static const uint64_t seed = [] {
+        const char* env = std::getenv("STRESS_SEED");
+        return env ? std::strtoull(env, nullptr, 10)
+                   : static_cast<uint64_t>(std::chrono::steady_clock::now()
+                                               .time_since_epoch().count());
+    }();
+    return seed;
+}
+
+// The seed of the index-th thread's stream: the splitmix64 finalizer, so the
+// streams of the neighboring indexes aren't correlated
+inline uint64_t stress_stream_seed(uint64_t index) {
+    uint64_t z = stress_seed() + (index + 1) * 0x9e3779b97f4a7c15;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+// The perturbation generator of the calling thread
+inline StressRandom& perturbation_random() {
+    // The threads without an index set take theirs from the upper half, so
+    // they don't share a stream with the indexed ones
+    static std::atomic<uint64_t> next_index(uint64_t(1) << 63);
+    thread_local StressRandom random(
+        stress_stream_seed(next_index.fetch_add(1, std::memory_order_relaxed)));
+    return random;
+}
+
+// Runs at the start of a stress thread. Replays the same perturbations for
+// the same seed and index.
+inline void set_stress_thread(uint64_t index) {
+    perturbation_random() = StressRandom(stress_stream_seed(index));
+}
+
+inline void schedule_point() {
+    StressRandom& random = perturbation_random();
+    size_t dice = random.below(100);
+    if (dice < 60) {
+        return;
+    } else if (dice < 85) {
+        std::this_thread::yield();
+    } else if (dice < 99) {
+        for (volatile size_t i = random.below(200) ; i > 0 ; i = i - 1);
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(random.below(50)));
+    }
+}
+
+#ifdef STRESS_PERTURB
+#define SCHEDULE_POINT() schedule_point()
+#endif
+
+// One recorded operation. Op carries both the arguments and the results.
+template<class Op>
+struct Operation {
+    Op op;
+    uint64_t invoked; // ns
+    uint64_t responded; // ns
+};
+
+inline uint64_t stress_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// OperationHistory
+//     Each thread records its operations into its own log, so recording adds
+//     no synchronization between the threads. Call history() after all the
+//     threads are joined.
+//
+// Usage:
+//     OperationHistory<QueueModel::Op> history(2);
+//     // On thread 0:
+//     uint64_t invoked = stress_now_ns();
+//     size_t written = ring.write(value);
+//     history.record(0, QueueModel::write({value}, written), invoked);
+template<class Op>
+class OperationHistory final {
+public:
+    explicit OperationHistory(size_t threads): logs(threads) {}
+
+    // Runs on the thread-th thread, right after the operation returns
+    void record(size_t thread, Op op, uint64_t invoked) {
+        assert(thread < logs.size());
+        logs[thread].push_back(Operation<Op>{ std::move(op), invoked,
+                                              stress_now_ns() });
+    }
+
+    std::vector<Operation<Op>> history() const {
+        std::vector<Operation<Op>> all;
+        for (const auto& log: logs) {
+            all.insert(all.end(), log.begin(), log.end());
+        }
+        return all;
+    }
+
+    void clear() {
+        for (auto& log: logs) {
+            log.clear();
+        }
+    }
+
+private:
+    std::vector<std::vector<Operation<Op>>> logs;
+};
+
+// LinearizabilityChecker
+//     Model is the sequential specification of the object under test:
+//
+//     struct Model {
+//         typedef ... Op;    // An operation with its arguments and results
+//         typedef ... State; // The object state. Must be copyable and ==
+//         static size_t hash(const State& s);
+//         // Apply op to s. Return false if the results in op are impossible
+//         // from state s.
+//         static bool step(State& s, const Op& op);
+//     };
+template<class Model>
+class LinearizabilityChecker final {
+public:
+    typedef typename Model::Op Op;
+    typedef typename Model::State State;
+
+    static bool check(const std::vector<Operation<Op>>& history,
+                      const State& initial) {
+        const size_t n = history.size();
+        if (n == 0) {
+            return true;
+        }
+
+        // Build a doubly linked list of the call and return events ordered
+        // by time. Event 2 * i is the call of operation i and 2 * i + 1 is
+        // its return. The head sentinel is at index 2 * n.
+        std::vector<size_t> events(2 * n);
+        for (size_t i = 0 ; i < 2 * n ; ++i) {
+            events[i] = i;
+        }
+        auto time_of = [&](size_t e) {
+            return e % 2 ? history[e / 2].responded : history[e / 2].invoked;
+        };
+        std::stable_sort(events.begin(), events.end(), [&](size_t a, size_t b) {
+            uint64_t ta = time_of(a);
+            uint64_t tb = time_of(b);
+            // On a tie, calls go first so the operations are seen concurrent
+            return ta != tb ? ta < tb : a % 2 < b % 2;
+        });
+        const size_t HEAD = 2 * n;
+        const size_t NONE = SIZE_MAX;
+        std::vector<size_t> next(2 * n + 1, NONE);
+        std::vector<size_t> prev(2 * n + 1, NONE);
+        size_t last = HEAD;
+        for (size_t e: events) {
+            next[last] = e;
+            prev[e] = last;
+            last = e;
+        }
+
+        auto lift = [&](size_t op) { // Remove the events of op from the list
+            for (size_t e: { 2 * op, 2 * op + 1 }) {
+                next[prev[e]] = next[e];
+                if (next[e] != NONE) {
+                    prev[next[e]] = prev[e];
+                }
+            }
+        };
+        auto unlift = [&](size_t op) { // Put them back, in reverse order
+            for (size_t e: { 2 * op + 1, 2 * op }) {
+                next[prev[e]] = e;
+                if (next[e] != NONE) {
+                    prev[next[e]] = e;
+                }
+            }
+        };
+
+        std::unordered_set<CacheEntry, CacheEntryHash> cache;
+        std::vector<std::pair<size_t, State>> stack; // (op, state before op)
+        std::vector<bool> linearized(n, false);
+        State state = initial;
+        size_t entry = next[HEAD];
+        while (next[HEAD] != NONE) {
+            if (entry % 2 == 0) { // A call: try to linearize it now
+                size_t op = entry / 2;
+                State after = state;
+                bool ok = Model::step(after, history[op].op);
+                if (ok) {
+                    linearized[op] = true;
+                    ok = cache.insert(CacheEntry{ linearized, after }).second;
+                    if (!ok) { // Seen this configuration before
+                        linearized[op] = false;
+                    }
+                }
+                if (ok) {
+                    stack.emplace_back(op, std::move(state));
+                    state = std::move(after);
+                    lift(op);
+                    entry = next[HEAD];
+                } else {
+                    entry = next[entry];
+                }
+            } else { // A return of a pending op: backtrack
+                if (stack.empty()) {
+                    return false;
+                }
+                size_t op = stack.back().first;
+                state = std::move(stack.back().second);
+                stack.pop_back();
+                linearized[op] = false;
+                unlift(op);
+                entry = next[2 * op];
+            }
+        }
+        return true;
+    }
+
+private:
+    struct CacheEntry {
+        std::vector<bool> linearized;
+        State state;
+        bool operator==(const CacheEntry& other) const {
+            return linearized == other.linearized && state == other.state;
+        }
+    };
+
+    struct CacheEntryHash {
+        size_t operator()(const CacheEntry& e) const {
+            return std::hash<std::vector<bool>>()(e.linearized) * 31 +
+                   Model::hash(e.state);
+        }
+    };
+};
+
+// QueueModel
+//     The sequential specification of a FIFO queue of integers with bounded
+//     capacity and batch operations, as SPSCRingBuffer's write_all(...) and
+//     read_all(). A write accepts values from the front of the batch, as
+//     long as they fit. A read returns at most the requested number of values
+//     from the front of the queue.
+//
+//     Both may do less than what's possible at their linearization points:
+//     SPSCRingBuffer sizes a transfer from the other side's cursor loaded at
+//     the start of the call, and the other side may move it before the call
+//     publishes its own cursor. So a write accepting fewer values than the
+//     free space, or a read returning fewer than available, is allowed, but
+//     reordered, duplicated, lost or overflowing values are not. Read the
+//     queue empty after the threads finish so the lost values are caught.
+struct QueueModel {
+    struct Op {
+        bool is_write;
+        std::vector<int64_t> values; // written or read values
+        size_t count; // accepted count for write, requested count for read
+    };
+
+    struct State {
+        size_t capacity;
+        std::vector<int64_t> items;
+        bool operator==(const State& other) const {
+            return items == other.items;
+        }
+    };
+
+    static Op write(std::vector<int64_t> values, size_t accepted) {
+        return Op{ true, std::move(values), accepted };
+    }
+
+    static Op read(size_t requested, std::vector<int64_t> values) {
+        return Op{ false, std::move(values), requested };
+    }
+
+    static State empty(size_t capacity) {
+        return State{ capacity, {} };
+    }
+
+    static size_t hash(const State& s) {
+        size_t h = 14695981039346656037ull;
+        for (int64_t v: s.items) {
+            h = (h ^ static_cast<size_t>(v)) * 1099511628211ull;
+        }
+        return h;
+    }
+
+    static bool step(State& s, const Op& op) {
+        if (op.is_write) {
+            size_t fit = std::min(op.values.size(), s.capacity - s.items.size());
+            if (op.count > fit) {
+                return false;
+            }
+            s.items.insert(s.items.end(), op.values.begin(),
+                           op.values.begin() + op.count);
+            return true;
+        }
+        size_t available = std::min(op.count, s.items.size());
+        if (op.values.size() > available ||
+            !std::equal(op.values.begin(), op.values.end(), s.items.begin())) {
+            return false;
+        }
+        s.items.erase(s.items.begin(), s.items.begin() + op.values.size());
+        return true;
+    }
+};
+
+#endif // Stress_h
\ No newline at end of file
@@ -0,0 +1,367 @@
+// Include stress.h first so SCHEDULE_POINT() is defined for the primitives
+#include "stress.h"
+
+#include "../ring_buffer/dynamic_ring_buffer.h"
+#include "../ring_buffer/eventfd_ring_buffer.h"
+#include "../ring_buffer/ring_buffer.h"
+#include "../task_queue/task_queue.h"
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+const size_t ROUNDS = 200;
+const size_t OPS_PER_THREAD = 100;
+
+size_t rounds() {
+    const char* env = std::getenv("STRESS_ROUNDS");
+    return env ? std::strtoul(env, nullptr, 10) : ROUNDS;
+}
+
+// The checker must reject a history where a value overtakes an earlier one
+void test_checker_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    typedef LinearizabilityChecker<QueueModel> Checker;
+    std::vector<Operation<QueueModel::Op>> history = {
+        { QueueModel::write({1}, 1), 0, 10 },
+        { QueueModel::write({2}, 1), 20, 30 },
+        { QueueModel::read(1, {2}), 40, 50 }, // 1 was enqueued before 2
+    };
+    assert(!Checker::check(history, QueueModel::empty(4)));
+
+    // It's fine if the two writes overlap
+    history[1].invoked = 5;
+    assert(Checker::check(history, QueueModel::empty(4)));
+
+    // A write to a full queue must accept nothing
+    history = {
+        { QueueModel::write({1, 2, 3}, 2), 0, 10 },
+        { QueueModel::write({4}, 1), 20, 30 },
+    };
+    assert(!Checker::check(history, QueueModel::empty(2)));
+    history[1].op.count = 0;
+    assert(Checker::check(history, QueueModel::empty(2)));
+
+    // A value can't be read twice
+    history = {
+        { QueueModel::write({1, 2}, 2), 0, 10 },
+        { QueueModel::read(2, {1}), 20, 30 },
+        { QueueModel::read(2, {1, 2}), 40, 50 },
+    };
+    assert(!Checker::check(history, QueueModel::empty(2)));
+
+    std::cout << "checker ok" << std::endl;
+}
+
+// One producer and one consumer run random mixes of write(), write_all(),
+// read() and read_all() on a small SPSCRingBuffer. Every round's history
+// must be linearizable to a bounded FIFO queue.
+void test_spsc_ring_buffer_stress() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    const size_t CAPACITY = 3;
+    OperationHistory<QueueModel::Op> history(2);
+
+    for (size_t round = 0 ; round < rounds() ; ++round) {
+        // std::string makes the element non-trivially copyable
+        SPSCRingBuffer<std::string> ring(CAPACITY);
+        history.clear();
+        std::atomic<bool> go(false);
+
+        std::thread producer([&] {
+            set_stress_thread(2 * round);
+            StressRandom random(stress_seed() + 2 * round);
+            int64_t next = 0;
+            while (!go);
+            for (size_t i = 0 ; i < OPS_PER_THREAD ; ++i) {
+                std::vector<int64_t> values(1 + random.below(CAPACITY + 1));
+                std::vector<std::string> data;
+                for (int64_t& v: values) {
+                    v = next++;
+                    data.emplace_back(std::to_string(v));
+                }
+                uint64_t invoked = stress_now_ns();
+                size_t written = data.size() == 1 ? ring.write(data[0])
+                                                  : ring.write_all(data);
+                history.record(0, QueueModel::write(values, written), invoked);
+                next -= values.size() - written; // Retry the rejected ones
+            }
+        });
+
+        std::thread consumer([&] {
+            set_stress_thread(2 * round + 1);
+            StressRandom random(stress_seed() + 2 * round + 1);
+            while (!go);
+            for (size_t i = 0 ; i < OPS_PER_THREAD ; ++i) {
+                std::vector<int64_t> values;
+                bool one = random.below(2);
+                uint64_t invoked = stress_now_ns();
+                if (one) {
+                    std::optional<std::string> s = ring.read();
+                    if (s) {
+                        values.push_back(std::stoll(*s));
+                    }
+                } else {
+                    for (const std::string& s: ring.read_all()) {
+                        values.push_back(std::stoll(s));
+                    }
+                }
+                history.record(1, QueueModel::read(one ? 1 : CAPACITY, values),
+                               invoked);
+            }
+        });
+
+        go = true;
+        producer.join();
+        consumer.join();
+
+        // Drain the ring so the lost values, if any, show up
+        std::vector<int64_t> rest;
+        uint64_t invoked = stress_now_ns();
+        for (const std::string& s: ring.read_all()) {
+            rest.push_back(std::stoll(s));
+        }
+        history.record(1, QueueModel::read(CAPACITY, rest), invoked);
+        assert(ring.read_all().empty());
+
+        if (!LinearizabilityChecker<QueueModel>::check(
+                history.history(), QueueModel::empty(CAPACITY))) {
+            std::cout << "Non-linearizable history in round " << round
+                      << ", seed " << stress_seed() << std::endl;
+            assert(false);
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    std::cout << rounds() << " rounds ok" << std::endl;
+}
+
+// Same as above on a DynamicSPSCRingBuffer with tiny blocks, so most of the
+// operations cross a block boundary or recycle a block. Writes never fail, so
+// the history must be linearizable to an unbounded FIFO queue.
+void test_dynamic_ring_buffer_stress() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    const size_t BLOCK_CAPACITY = 2;
+    const size_t MAX_BATCH = 5;
+    OperationHistory<QueueModel::Op> history(2);
+
+    for (size_t round = 0 ; round < rounds() ; ++round) {
+        DynamicSPSCRingBuffer<std::string> ring(BLOCK_CAPACITY, 1);
+        history.clear();
+        std::atomic<bool> go(false);
+
+        std::thread producer([&] {
+            set_stress_thread(2 * round);
+            StressRandom random(stress_seed() + 2 * round);
+            int64_t next = 0;
+            while (!go);
+            for (size_t i = 0 ; i < OPS_PER_THREAD ; ++i) {
+                std::vector<int64_t> values(1 + random.below(MAX_BATCH));
+                std::vector<std::string> data;
+                for (int64_t& v: values) {
+                    v = next++;
+                    data.emplace_back(std::to_string(v));
+                }
+                uint64_t invoked = stress_now_ns();
+                size_t written = data.size() == 1 ? ring.write(data[0])
+                                                  : ring.write_all(data);
+                assert(written == data.size());
+                history.record(0, QueueModel::write(values, written), invoked);
+            }
+        });
+
+        std::thread consumer([&] {
+            set_stress_thread(2 * round + 1);
+            StressRandom random(stress_seed() + 2 * round + 1);
+            while (!go);
+            for (size_t i = 0 ; i < OPS_PER_THREAD ; ++i) {
+                std::vector<int64_t> values;
+                bool one = random.below(2);
+                uint64_t invoked = stress_now_ns();
+                if (one) {
+                    std::optional<std::string> s = ring.read();
+                    if (s) {
+                        values.push_back(std::stoll(*s));
+                    }
+                } else {
+                    for (const std::string& s: ring.read_all()) {
+                        values.push_back(std::stoll(s));
+                    }
+                }
+                history.record(1, QueueModel::read(one ? 1 : SIZE_MAX, values),
+                               invoked);
+            }
+        });
+
+        go = true;
+        producer.join();
+        consumer.join();
+
+        std::vector<int64_t> rest;
+        uint64_t invoked = stress_now_ns();
+        for (const std::string& s: ring.read_all()) {
+            rest.push_back(std::stoll(s));
+        }
+        history.record(1, QueueModel::read(SIZE_MAX, rest), invoked);
+        assert(ring.read_all().empty());
+
+        if (!LinearizabilityChecker<QueueModel>::check(
+                history.history(), QueueModel::empty(SIZE_MAX))) {
+            std::cout << "Non-linearizable history in round " << round
+                      << ", seed " << stress_seed() << std::endl;
+            assert(false);
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    std::cout << rounds() << " rounds ok" << std::endl;
+}
+
+// The consumer of an EventfdSPSCRingBuffer sleeps in epoll_wait(...) while
+// the producer writes in random bursts. A write racing with the consumer
+// arming the notification must still wake it up: a wait timing out with data
+// left to read is a lost wakeup.
+void test_eventfd_ring_buffer_stress() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    const size_t MAX_BURST = 4;
+    const int LOST_WAKEUP_MS = 2000;
+    uint64_t wakeups = 0;
+
+    for (size_t round = 0 ; round < rounds() ; ++round) {
+        auto ring = EventfdSPSCRingBuffer<uint64_t>::create(2);
+        assert(ring);
+        std::atomic<bool> go(false);
+
+        std::thread producer([&] {
+            set_stress_thread(round);
+            StressRandom random(stress_seed() + round);
+            uint64_t next = 0;
+            while (!go);
+            while (next < OPS_PER_THREAD) {
+                size_t burst = 1 + random.below(MAX_BURST);
+                for (size_t i = 0 ; i < burst && next < OPS_PER_THREAD ; ++i) {
+                    while (!ring->write(next)) {
+                        std::this_thread::yield();
+                    }
+                    ++next;
+                }
+                if (random.below(2)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+
+        int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        assert(epoll_fd >= 0);
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        assert(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ring->fd(), &ev) == 0);
+        // The consumer runs on this thread
+        set_stress_thread(rounds() + round);
+        go = true;
+        uint64_t expected = 0;
+        while (expected < OPS_PER_THREAD) {
+            if (epoll_wait(epoll_fd, &ev, 1, LOST_WAKEUP_MS) != 1) {
+                std::cout << "Lost wakeup in round " << round << ", seed "
+                          << stress_seed() << std::endl;
+                assert(false);
+                std::exit(EXIT_FAILURE);
+            }
+            ++wakeups;
+            std::vector<uint64_t> batch;
+            while (!(batch = ring->read_all()).empty()) {
+                for (uint64_t value: batch) {
+                    assert(value == expected);
+                    ++expected;
+                }
+            }
+        }
+        producer.join();
+        close(epoll_fd);
+    }
+    std::cout << rounds() << " rounds ok, " << wakeups << " wakeups" << std::endl;
+}
+
+// Several threads dispatch to a SerialTaskQueue at once. The order in which
+// the tasks run must be linearizable to a FIFO queue, where dispatch() is the
+// enqueue and the start of a task is the dequeue.
+void test_serial_task_queue_stress() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    const size_t DISPATCHERS = 3;
+    // The dispatchers take slots [0, DISPATCHERS) and the worker takes the last
+    OperationHistory<QueueModel::Op> history(DISPATCHERS + 1);
+
+    for (size_t round = 0 ; round < rounds() / 10 ; ++round) {
+        history.clear();
+        std::vector<std::future<void>> futures[DISPATCHERS];
+        {
+            SerialTaskQueue q;
+            std::atomic<bool> go(false);
+            std::vector<std::thread> dispatchers;
+            for (size_t d = 0 ; d < DISPATCHERS ; ++d) {
+                dispatchers.emplace_back([&, d] {
+                    set_stress_thread(round * DISPATCHERS + d);
+                    StressRandom random(stress_seed() + round * DISPATCHERS + d);
+                    while (!go);
+                    for (size_t i = 0 ; i < OPS_PER_THREAD / DISPATCHERS ; ++i) {
+                        int64_t value = d * OPS_PER_THREAD + i;
+                        uint64_t invoked = stress_now_ns();
+                        futures[d].emplace_back(q.dispatch([&, value] {
+                            // Only the single worker writes the last slot
+                            uint64_t now = stress_now_ns();
+                            history.record(DISPATCHERS,
+                                           QueueModel::read(1, {value}), now);
+                        }));
+                        history.record(d, QueueModel::write({value}, 1),
+                                       invoked);
+                        if (random.below(4) == 0) {
+                            schedule_point();
+                        }
+                    }
+                });
+            }
+            go = true;
+            for (std::thread& d: dispatchers) {
+                d.join();
+            }
+            for (auto& fs: futures) {
+                for (std::future<void>& f: fs) {
+                    f.wait();
+                }
+            }
+        }
+
+        if (!LinearizabilityChecker<QueueModel>::check(
+                history.history(), QueueModel::empty(SIZE_MAX))) {
+            std::cout << "Non-linearizable history in round " << round
+                      << ", seed " << stress_seed() << std::endl;
+            assert(false);
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    std::cout << rounds() / 10 << " rounds ok" << std::endl;
+}
+
+int main() {
+    std::cout << "seed: " << stress_seed()
+#ifdef STRESS_PERTURB
+              << " (schedule perturbed)"
+#endif
+              << std::endl;
+    test_checker_example();
+    test_spsc_ring_buffer_stress();
+    test_dynamic_ring_buffer_stress();
+    test_eventfd_ring_buffer_stress();
+    test_serial_task_queue_stress();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,168 @@
+#ifndef Cancellation_h
+#define Cancellation_h
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Cooperative cancellation for the tasks of TaskQueue and
+// SimpleSerialTaskQueue.
+//
+// A CancellationSource owns the cancellation state and hands out
+// CancellationTokens observing it. Cancelling the source can't stop a task
+// in the middle, but:
+// - a queued task dispatched with a cancelled token is skipped when a worker
+//   takes it, and its future, if any, throws TaskCancelled from get()
+// - a running task holding the token can poll is_cancelled(), which is a
+//   single atomic load, and give up early
+//
+// A source made from a parent token is a child of the parent's source, and is
+// cancelled when the parent is. Give each request a source, and the sources
+// of its fan-out children of it, to abort the whole request at once.
+//
+// Usage:
+//     CancellationSource request;
+//     CancellationSource step(request.token()); // A child of request
+//     auto f = q.dispatch(step.token(), [token = step.token()] {
+//         while (!token.is_cancelled()) {
+//             ... // Do a part of the work
+//         }
+//     });
+//     request.cancel(); // Cancels step too
+//     f.get(); // Throws TaskCancelled if the task hasn't started
+
+// The exception stored in the future of a cancelled task
+class TaskCancelled final: public std::exception {
+public:
+    const char* what() const noexcept override {
+        return "task cancelled";
+    }
+};
+
+class CancellationSource;
+
+// CancellationToken
+//     A cheap, copyable view on a CancellationSource. A default-constructed
+//     token is never cancelled. It keeps the state alive, so it can outlive
+//     its source.
+class CancellationToken final {
+public:
+    CancellationToken() = default;
+
+    // Runs on any thread
+    bool is_cancelled() const {
+        return state && state->cancelled.load(std::memory_order_acquire);
+    }
+
+    // Runs on any thread
+    void throw_if_cancelled() const {
+        if (is_cancelled()) {
+            throw TaskCancelled();
+        }
+    }
+
+private:
+    friend class CancellationSource;
+
+    struct State {
+        std::atomic<bool> cancelled { false };
+        std::mutex mutex;
+        std::vector<std::weak_ptr<State>> children; // Protected by mutex
+        size_t prune_at = 16; // Protected by mutex
+    };
+
+    explicit CancellationToken(std::shared_ptr<State> s): state(std::move(s)) {}
+
+    std::shared_ptr<State> state;
+};
+
+// CancellationSource
+//     Cancels the tokens it has handed out, and its child sources. Cancelling
+//     is one-way and idempotent.
+class CancellationSource final {
+public:
+    CancellationSource(): state(std::make_shared<State>()) {}
+
+    // A child source, cancelled when parent's source is. It starts cancelled
+    // if parent already is.
+    explicit CancellationSource(const CancellationToken& parent)
+        : state(std::make_shared<State>()) {
+        if (!parent.state) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(parent.state->mutex); // Enter critical section
+            // Checked in the critical section, so a concurrent cancel() of
+            // the parent either sees this child or has set the flag before
+            if (!parent.state->cancelled.load(std::memory_order_relaxed)) {
+                add_child(*parent.state, state);
+                return;
+            }
+        } // Leave critical section
+        cancel();
+    }
+
+    ~CancellationSource() = default;
+
+    CancellationToken token() const {
+        return CancellationToken(state);
+    }
+
+    // Runs on any thread
+    void cancel() {
+        cancel(state);
+    }
+
+    // Runs on any thread
+    bool is_cancelled() const {
+        return state->cancelled.load(std::memory_order_acquire);
+    }
+
+    // Disallowed operations
+    CancellationSource(const CancellationSource& other) = delete;
+    CancellationSource(CancellationSource&& other) = delete;
+    CancellationSource& operator=(const CancellationSource& other) = delete;
+    CancellationSource& operator=(CancellationSource&& other) = delete;
+
+private:
+    typedef CancellationToken::State State;
+
+    static void cancel(const std::shared_ptr<State>& s) {
+        std::vector<std::weak_ptr<State>> children;
+        {
+            std::lock_guard<std::mutex> guard(s->mutex); // Enter critical section
+            if (s->cancelled.exchange(true, std::memory_order_acq_rel)) {
+                return; // Cancelled already, so are the children
+            }
+            children.swap(s->children);
+        } // Leave critical section
+        for (std::weak_ptr<State>& child: children) {
+            if (std::shared_ptr<State> c = child.lock()) {
+                cancel(c);
+            }
+        }
+    }
+
+    // Runs in the critical section of parent. Drop the children gone
+    // already from time to time, so a long-lived parent with many
+    // short-lived children doesn't grow forever.
+    static void add_child(State& parent, const std::shared_ptr<State>& child) {
+        std::vector<std::weak_ptr<State>>& children = parent.children;
+        if (children.size() >= parent.prune_at) {
+            children.erase(std::remove_if(children.begin(), children.end(),
+                                          [](const std::weak_ptr<State>& c) {
+                                              return c.expired();
+                                          }),
+                           children.end());
+            parent.prune_at = std::max<size_t>(16, 2 * children.size());
+        }
+        children.push_back(child);
+    }
+
+    std::shared_ptr<State> state;
+};
+
+#endif // Cancellation_h
\ No newline at end of file
@@ -0,0 +1,136 @@
+#include "cancellation.h"
+#include "simple_serial_task_queue.h"
+#include "task_queue.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+void test_token_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    CancellationToken never;
+    assert(!never.is_cancelled());
+
+    CancellationSource request;
+    CancellationSource step_1(request.token());
+    CancellationSource step_2(request.token());
+    CancellationSource sub_step(step_2.token());
+    CancellationToken token = sub_step.token();
+    assert(!token.is_cancelled());
+
+    // Cancelling a child leaves the parent and the siblings alone
+    step_1.cancel();
+    assert(step_1.is_cancelled());
+    assert(!request.is_cancelled() && !step_2.is_cancelled());
+
+    // Cancelling the parent cancels the whole tree
+    request.cancel();
+    request.cancel(); // It's ok to cancel twice
+    assert(step_2.is_cancelled() && token.is_cancelled());
+
+    // A child of a cancelled source starts cancelled
+    CancellationSource late(request.token());
+    assert(late.is_cancelled());
+
+    bool thrown = false;
+    try {
+        token.throw_if_cancelled();
+    } catch (const TaskCancelled& e) {
+        thrown = true;
+        std::cout << "caught: " << e.what() << std::endl;
+    }
+    assert(thrown);
+}
+
+void test_task_queue_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    const size_t TASKS = 5;
+    std::atomic<size_t> ran(0);
+    TaskQueue q(1);
+
+    // Hold the only worker so the next tasks stay in the queue
+    std::promise<void> gate;
+    std::shared_future<void> opened(gate.get_future());
+    std::future<void> blocker = q.dispatch([opened] { opened.wait(); });
+
+    CancellationSource request;
+    CancellationSource other;
+    std::vector<std::future<size_t>> futures;
+    for (size_t i = 0 ; i < TASKS ; ++i) {
+        CancellationSource step(request.token());
+        futures.push_back(q.dispatch(step.token(), [&ran, i] {
+            ++ran;
+            return i;
+        }));
+    }
+    std::future<int> kept = q.dispatch(other.token(), [] { return 42; });
+
+    // The client is gone: drop all its queued work at once
+    request.cancel();
+    gate.set_value();
+    blocker.wait();
+
+    for (std::future<size_t>& f: futures) {
+        bool cancelled = false;
+        try {
+            f.get();
+        } catch (const TaskCancelled&) {
+            cancelled = true;
+        }
+        assert(cancelled);
+    }
+    assert(kept.get() == 42);
+    assert(ran == 0);
+
+    // A running task polls its token to give up early
+    CancellationSource job;
+    std::atomic<bool> started(false);
+    std::future<size_t> rounds = q.dispatch(job.token(),
+                                            [&started, token = job.token()] {
+        started = true;
+        size_t n = 0;
+        while (!token.is_cancelled()) {
+            ++n;
+            std::this_thread::yield();
+        }
+        return n;
+    });
+    while (!started) {
+        std::this_thread::yield();
+    }
+    job.cancel();
+    std::cout << "running task stopped after " << rounds.get() << " rounds"
+              << std::endl;
+}
+
+void test_serial_queue_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    std::vector<int> ran;
+    SimpleSerialTaskQueue q;
+    CancellationSource source;
+    std::promise<void> gate;
+    std::future<void> opened = gate.get_future();
+    q.dispatch([&] { opened.wait(); });
+    q.dispatch(source.token(), [&] { ran.push_back(1); });
+    q.dispatch([&] { ran.push_back(2); });
+    q.dispatch(source.token(), [&] { ran.push_back(3); });
+    source.cancel();
+    gate.set_value();
+    q.wait();
+    assert(ran == std::vector<int>({ 2 }));
+    std::cout << "only the task without the token ran" << std::endl;
+}
+
+int main() {
+    test_token_example();
+    test_task_queue_example();
+    test_serial_queue_example();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,342 @@
+#ifndef Channel_h
+#define Channel_h
+
+#include "../mutex/futex_mutex.h"
+#include "../ring_buffer/dynamic_ring_buffer.h"
+#include "../ring_buffer/ring_buffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Channel
+//     A typed pipe between the stages of a pipeline running on TaskQueues. A
+//     stage polling an SPSCRingBuffer from inside a task either spins or
+//     sleeps between the polls. A channel runs the consumer instead: it's
+//     dispatched to a TaskQueue, or a serial queue acting as a strand, only
+//     once there is data to take.
+//
+//     The data goes through a ring buffer of the repo:
+//     - BoundedChannel<T> is on an SPSCRingBuffer. send(...) fails when it's
+//       full, and on_writable(...) dispatches the producer again once the
+//       consumer has made room, so the memory of a pipeline stays bounded.
+//     - UnboundedChannel<T> is on a DynamicSPSCRingBuffer, and send(...)
+//       always succeeds until the channel is closed.
+//     The rings have one producer and one consumer. In the MPSC and MPMC
+//     modes a FutexMutex serializes the producers, and the consumers too in
+//     MPMC.
+//
+//     receive_async(queue, f) dispatches f(std::vector<T>&&) to queue with
+//     everything readable at once, so one wakeup drains a whole burst. An
+//     empty batch means the channel is closed and drained. A consumer calls
+//     receive_async(...) again from f to keep receiving; in the SPSC and
+//     MPSC modes it must have one receive outstanding at a time.
+//
+//     select(queue, f, channels...) dispatches f(index) once one of the
+//     channels, of any types, has data or is closed. f then receives from
+//     channels[index] with try_receive().
+//
+//     A producer and a consumer meet on the ring and a flag: the producer
+//     writes the ring then checks whether a consumer is waiting, while the
+//     consumer registers its callback then checks whether the ring has
+//     data. Both with a sequentially consistent fence in between, so one of
+//     them always sees the other and no wakeup is lost. A consumer is woken
+//     up only once the data is in the ring, never by a send in progress.
+//     The count of pending elements is only for the room of a bounded
+//     channel, and size().
+//
+//     close() stops the sends and wakes up everyone waiting. It runs on a
+//     producer. The channel and the queues must outlive the pending
+//     callbacks, and the callbacks must be copyable.
+//
+// Usage:
+//     BoundedChannel<Order> orders(1024, ChannelMode::MPSC);
+//     SerialTaskQueue strand;
+//     std::function<void(std::vector<Order>&&)> on_orders =
+//         [&](std::vector<Order>&& batch) {
+//             if (batch.empty()) {
+//                 return; // Closed
+//             }
+//             match(batch);
+//             orders.receive_async(strand, on_orders);
+//         };
+//     orders.receive_async(strand, on_orders);
+//     orders.send(order); // Any producer thread
+//     orders.close();
+
+enum class ChannelMode {
+    SPSC, // One producer and one consumer at a time
+    MPSC, // Many producers and one consumer at a time
+    MPMC, // Many producers and many consumers
+};
+
+template<class T, class Ring>
+class Channel final {
+public:
+    static constexpr bool BOUNDED = std::is_same<Ring, SPSCRingBuffer<T>>::value;
+
+    // capacity is the capacity of a bounded channel, or the block capacity
+    // of an unbounded one
+    explicit Channel(size_t capacity, ChannelMode mode = ChannelMode::SPSC)
+        : ring(capacity)
+        , mode(mode)
+        , pending(0)
+        , closed(false) {}
+
+    ~Channel() = default;
+
+    // Runs on producer thread. Returns false if the channel is full or
+    // closed.
+    bool send(const T& value) {
+        return send_all(&value, 1) == 1;
+    }
+
+    // Runs on producer thread. Returns the number of elements sent, which
+    // falls short if the channel gets full.
+    size_t send_all(const std::vector<T>& values) {
+        return send_all(values.data(), values.size());
+    }
+
+    // Runs on consumer thread. Everything readable now, or nothing.
+    std::vector<T> try_receive() {
+        std::vector<T> values;
+        {
+            OptionalLock guard(consumer_mutex, mode == ChannelMode::MPMC); // Enter critical section
+            values = ring.read_all();
+        } // Leave critical section
+        if (!values.empty()) {
+            pending.fetch_sub(values.size(), std::memory_order_seq_cst);
+            writable.notify();
+        }
+        return values;
+    }
+
+    // Dispatch f(std::vector<T>&&) to queue with the elements readable once
+    // there are some, or with none once the channel is closed and drained
+    template<class Queue, class F>
+    void receive_async(Queue& queue, F f) {
+        // Whatever was sent before close() is in the ring by now
+        bool was_closed = closed.load(std::memory_order_acquire);
+        std::vector<T> values = try_receive();
+        if (!values.empty() || was_closed) {
+            queue.dispatch([f, values = std::move(values)]() mutable {
+                f(std::move(values));
+            });
+            return;
+        }
+        // Try again on queue once woken up, since another consumer may have
+        // taken the data by then
+        watch(std::make_shared<std::atomic<bool>>(false), [this, &queue, f] {
+            queue.dispatch([this, &queue, f] {
+                receive_async(queue, f);
+            });
+        });
+    }
+
+    // Dispatch f() to queue once a bounded channel has room, or is closed.
+    // Right away for an unbounded channel. f should try send(...) again, and
+    // call on_writable(...) again if another producer has taken the room.
+    template<class Queue, class F>
+    void on_writable(Queue& queue, F f) {
+        auto wake = [&queue, f] {
+            queue.dispatch(f);
+        };
+        if (!BOUNDED) {
+            wake();
+            return;
+        }
+        auto done = std::make_shared<std::atomic<bool>>(false);
+        writable.arm(Waiter { done, wake });
+        if (has_room() || closed.load(std::memory_order_seq_cst)) {
+            writable.notify();
+        }
+    }
+
+    // Runs on producer thread
+    void close() {
+        {
+            OptionalLock guard(producer_mutex, mode != ChannelMode::SPSC); // Enter critical section
+            closed.store(true, std::memory_order_seq_cst);
+        } // Leave critical section
+        readable.notify();
+        writable.notify();
+    }
+
+    bool is_closed() const {
+        return closed.load(std::memory_order_acquire);
+    }
+
+    // The elements sent and not received yet, roughly: it includes the ones
+    // being sent
+    size_t size() const {
+        return pending.load(std::memory_order_relaxed);
+    }
+
+    // Disallowed operations
+    Channel(const Channel& other) = delete;
+    Channel(Channel&& other) = delete;
+    Channel& operator=(const Channel& other) = delete;
+    Channel& operator=(Channel&& other) = delete;
+
+private:
+    template<class Queue, class F, class... Channels>
+    friend void select(Queue& queue, F f, Channels&... channels);
+
+    // Locks the mutex only if the mode needs it
+    class OptionalLock final {
+    public:
+        OptionalLock(FutexMutex& mutex, bool enabled)
+            : mutex(enabled ? &mutex : nullptr) {
+            if (this->mutex) {
+                this->mutex->lock();
+            }
+        }
+
+        ~OptionalLock() {
+            if (mutex) {
+                mutex->unlock();
+            }
+        }
+
+    private:
+        FutexMutex* const mutex;
+    };
+
+    // A callback to run once. The flag is shared by all the channels a
+    // select(...) watches, so only the first one ready runs it.
+    struct Waiter {
+        std::shared_ptr<std::atomic<bool>> done;
+        std::function<void()> wake;
+    };
+
+    // The waiters of one side of the channel
+    class Signal final {
+    public:
+        Signal(): armed(false) {}
+
+        // The caller checks its condition again after this
+        void arm(Waiter waiter) {
+            std::lock_guard<std::mutex> guard(mutex); // Enter critical section
+            // Drop the waiters of the selects done on other channels
+            waiters.erase(std::remove_if(waiters.begin(), waiters.end(),
+                                         [](const Waiter& w) {
+                                             return w.done->load(std::memory_order_relaxed);
+                                         }),
+                          waiters.end());
+            waiters.push_back(std::move(waiter));
+            armed.store(true, std::memory_order_seq_cst);
+        } // Leave critical section
+
+        // The caller has made the condition true before this
+        void notify() {
+            if (!armed.load(std::memory_order_seq_cst)) {
+                return; // No syscall, no lock when no one waits
+            }
+            std::vector<Waiter> woken;
+            {
+                std::lock_guard<std::mutex> guard(mutex); // Enter critical section
+                woken.swap(waiters);
+                armed.store(false, std::memory_order_relaxed);
+            } // Leave critical section
+            for (Waiter& w: woken) {
+                if (!w.done->exchange(true, std::memory_order_acq_rel)) {
+                    w.wake();
+                }
+            }
+        }
+
+    private:
+        std::atomic<bool> armed;
+        std::mutex mutex;
+        std::vector<Waiter> waiters; // Protected by mutex
+    };
+
+    size_t send_all(const T* values, size_t count) {
+        size_t sent;
+        {
+            OptionalLock guard(producer_mutex, mode != ChannelMode::SPSC); // Enter critical section
+            if (closed.load(std::memory_order_relaxed)) {
+                return 0;
+            }
+            // Counted before the write, so a consumer taking the elements
+            // right away never brings pending below 0. The part not sent is
+            // given back.
+            pending.fetch_add(count, std::memory_order_seq_cst);
+            // Straight from values, without a std::vector in between
+            sent = count == 1 ? ring.write(*values)
+                              : ring.write(values, count);
+            if (sent < count) {
+                pending.fetch_sub(count - sent, std::memory_order_seq_cst);
+            }
+        } // Leave critical section
+        if (sent) {
+            // Pairs with the fence in watch(...)
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            readable.notify();
+        }
+        return sent;
+    }
+
+    bool has_room() const {
+        if constexpr (BOUNDED) {
+            return pending.load(std::memory_order_seq_cst) < ring.capacity();
+        }
+        return true;
+    }
+
+    // Run waiter once there is data to take or the channel is closed
+    void watch(std::shared_ptr<std::atomic<bool>> done, std::function<void()> wake) {
+        if (done->load(std::memory_order_relaxed)) {
+            return;
+        }
+        readable.arm(Waiter { std::move(done), std::move(wake) });
+        // Pairs with the fence in send_all(...): either this sees the data
+        // written, or the producer sees the waiter
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!ring_empty() || closed.load(std::memory_order_seq_cst)) {
+            readable.notify();
+        }
+    }
+
+    // Runs on consumer thread
+    bool ring_empty() {
+        OptionalLock guard(consumer_mutex, mode == ChannelMode::MPMC); // Enter critical section
+        return ring.empty();
+    } // Leave critical section
+
+    Ring ring;
+    const ChannelMode mode;
+    FutexMutex producer_mutex;
+    FutexMutex consumer_mutex;
+    alignas(64) std::atomic<size_t> pending; // Being sent, or sent but not received yet
+    std::atomic<bool> closed;
+    Signal readable;
+    Signal writable;
+};
+
+template<class T>
+using BoundedChannel = Channel<T, SPSCRingBuffer<T>>;
+
+template<class T>
+using UnboundedChannel = Channel<T, DynamicSPSCRingBuffer<T>>;
+
+// Dispatch f(index) to queue once, when the first of channels has data or is
+// closed. The channels can carry different types.
+template<class Queue, class F, class... Channels>
+void select(Queue& queue, F f, Channels&... channels) {
+    auto done = std::make_shared<std::atomic<bool>>(false);
+    size_t index = 0;
+    (channels.watch(done, [&queue, f, i = index++] {
+        queue.dispatch([f, i] {
+            f(i);
+        });
+    }), ...);
+}
+
+#endif // Channel_h
\ No newline at end of file
@@ -0,0 +1,246 @@
+#include "channel.h"
+#include "simple_serial_task_queue.h"
+#include "task_queue.h"
+
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+const int PRODUCERS = 3;
+const int VALUES = 10000;
+
+void test_channel_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    BoundedChannel<int> channel(2);
+    assert(channel.send(1));
+    assert(channel.send(2));
+    assert(!channel.send(3)); // Full
+    assert(channel.size() == 2);
+    assert(channel.try_receive() == std::vector<int>({ 1, 2 }));
+    assert(channel.try_receive().empty());
+
+    assert(channel.send(3));
+    channel.close();
+    assert(!channel.send(4));
+
+    // The data sent before close() is still received, then an empty batch
+    SimpleSerialTaskQueue strand;
+    std::promise<void> closed;
+    std::function<void(std::vector<int>&&)> on_batch = [&](std::vector<int>&& batch) {
+        if (batch.empty()) {
+            std::cout << "Closed" << std::endl;
+            closed.set_value();
+            return;
+        }
+        std::cout << "Received " << batch.size() << " values" << std::endl;
+        assert(batch == std::vector<int>({ 3 }));
+        channel.receive_async(strand, on_batch);
+    };
+    channel.receive_async(strand, on_batch);
+    closed.get_future().wait();
+}
+
+void test_channel_pipeline() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    // Producers -> numbers -> square on a strand -> squares -> sum
+    TaskQueue q(2);
+    SerialTaskQueue square_strand;
+    SerialTaskQueue sum_strand;
+    BoundedChannel<int> numbers(64, ChannelMode::MPSC);
+    UnboundedChannel<long> squares(128);
+
+    std::function<void(std::vector<int>&&)> square = [&](std::vector<int>&& batch) {
+        if (batch.empty()) {
+            squares.close();
+            return;
+        }
+        for (int n: batch) {
+            squares.send(static_cast<long>(n) * n);
+        }
+        numbers.receive_async(square_strand, square);
+    };
+
+    long sum = 0; // Accessed on sum_strand only
+    size_t batches = 0;
+    std::promise<long> result;
+    std::function<void(std::vector<long>&&)> add = [&](std::vector<long>&& batch) {
+        if (batch.empty()) {
+            result.set_value(sum);
+            return;
+        }
+        ++batches;
+        for (long n: batch) {
+            sum += n;
+        }
+        squares.receive_async(sum_strand, add);
+    };
+
+    numbers.receive_async(square_strand, square);
+    squares.receive_async(sum_strand, add);
+
+    // The producers wait for room without polling: a full channel dispatches
+    // them again once the consumer has drained it
+    std::atomic<int> producers_done(0);
+    std::vector<std::function<void()>> producers(PRODUCERS);
+    std::vector<int> next(PRODUCERS, 1);
+    for (int p = 0 ; p < PRODUCERS ; ++p) {
+        producers[p] = [&, p] {
+            while (next[p] <= VALUES) {
+                if (!numbers.send(next[p])) {
+                    numbers.on_writable(q, producers[p]);
+                    return;
+                }
+                ++next[p];
+            }
+            if (++producers_done == PRODUCERS) {
+                numbers.close();
+            }
+        };
+        q.dispatch(producers[p]);
+    }
+
+    long expected = 0;
+    for (long n = 1 ; n <= VALUES ; ++n) {
+        expected += PRODUCERS * n * n;
+    }
+    long total = result.get_future().get();
+    std::cout << "Sum of squares: " << total << " in " << batches
+              << " batches" << std::endl;
+    assert(total == expected);
+}
+
+void test_channel_mpmc() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    // Two consumers take turns on one channel, each receiving on its own
+    TaskQueue q(4);
+    UnboundedChannel<int> jobs(16, ChannelMode::MPMC);
+    std::atomic<long> sum(0);
+    std::atomic<int> closed(0);
+    std::promise<void> done;
+    std::function<void(std::vector<int>&&)> consume = [&](std::vector<int>&& batch) {
+        if (batch.empty()) {
+            if (++closed == 2) {
+                done.set_value();
+            }
+            return;
+        }
+        for (int n: batch) {
+            sum += n;
+        }
+        jobs.receive_async(q, consume);
+    };
+    jobs.receive_async(q, consume);
+    jobs.receive_async(q, consume);
+
+    std::vector<std::thread> producers;
+    for (int p = 0 ; p < PRODUCERS ; ++p) {
+        producers.emplace_back([&] {
+            for (int i = 1 ; i <= VALUES ; ++i) {
+                assert(jobs.send(i));
+            }
+        });
+    }
+    for (std::thread& t: producers) {
+        t.join();
+    }
+    jobs.close();
+    done.get_future().wait();
+    std::cout << "Sum: " << sum << std::endl;
+    assert(sum == static_cast<long>(PRODUCERS) * VALUES * (VALUES + 1) / 2);
+}
+
+void test_channel_backpressure() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    // The producers of a tiny channel keep waiting in on_writable(...) while
+    // the consumer drains it concurrently. A producer never woken up once
+    // there is room would time out here.
+    const int ROUNDS = 50;
+    const int PER_PRODUCER = 100;
+    const auto LOST_WAKEUP = std::chrono::seconds(2);
+    SimpleSerialTaskQueue wake_queue;
+    size_t waits = 0;
+    for (int round = 0 ; round < ROUNDS ; ++round) {
+        BoundedChannel<int> channel(1, ChannelMode::MPSC);
+        std::atomic<size_t> round_waits(0);
+        std::vector<std::thread> producers;
+        for (int p = 0 ; p < PRODUCERS ; ++p) {
+            producers.emplace_back([&] {
+                for (int i = 1 ; i <= PER_PRODUCER ; ++i) {
+                    while (!channel.send(i)) {
+                        auto writable = std::make_shared<std::promise<void>>();
+                        std::future<void> woken = writable->get_future();
+                        channel.on_writable(wake_queue, [writable] {
+                            writable->set_value();
+                        });
+                        ++round_waits;
+                        assert(woken.wait_for(LOST_WAKEUP) ==
+                               std::future_status::ready);
+                    }
+                }
+            });
+        }
+        long sum = 0;
+        const long expected = static_cast<long>(PRODUCERS) * PER_PRODUCER *
+                              (PER_PRODUCER + 1) / 2;
+        while (sum < expected) {
+            for (int n: channel.try_receive()) {
+                sum += n;
+            }
+            // The full ring and one element being sent, never a count
+            // wrapped below 0
+            assert(channel.size() <= 2);
+        }
+        for (std::thread& t: producers) {
+            t.join();
+        }
+        assert(sum == expected);
+        assert(channel.try_receive().empty());
+        waits += round_waits;
+    }
+    wake_queue.wait();
+    std::cout << ROUNDS << " rounds, " << waits << " waits for room" << std::endl;
+}
+
+void test_select_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    SimpleSerialTaskQueue strand;
+    BoundedChannel<int> numbers(8);
+    UnboundedChannel<std::string> words(8);
+
+    // Nothing is ready yet, so f runs once the first channel gets data
+    std::promise<size_t> ready;
+    select(strand, [&](size_t index) { ready.set_value(index); }, numbers, words);
+    words.send("hello");
+    size_t index = ready.get_future().get();
+    std::cout << "Channel " << index << " is ready" << std::endl;
+    assert(index == 1);
+    assert(words.try_receive() == std::vector<std::string>({ "hello" }));
+
+    // f runs only once though both channels get ready
+    std::atomic<int> calls(0);
+    select(strand, [&](size_t) { ++calls; }, numbers, words);
+    numbers.send(1);
+    words.close();
+    strand.dispatch([] {});
+    strand.wait();
+    assert(calls == 1);
+}
+
+int main() {
+    test_channel_example();
+    test_channel_pipeline();
+    test_channel_mpmc();
+    test_channel_backpressure();
+    test_select_example();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+#ifndef CompletionQueue_h
+#define CompletionQueue_h
+
+#include "../mutex/data_mutex.h"
+#include "../ring_buffer/eventfd_ring_buffer.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+// CompletionQueue
+//     Hands the results of the tasks run on a TaskQueue back to a thread
+//     running an epoll loop, e.g., the network thread. That thread can't
+//     block on a future or a condition variable, so the results usually take
+//     an extra hop through a queue it polls. Here the workers post the
+//     results, and the epoll thread sleeps in epoll_wait(...) on fd() and
+//     drains them all at once when it wakes up.
+//
+//     Only the post into an empty queue notifies the eventfd, so a burst of
+//     completions costs one syscall. drain() clears the eventfd before taking
+//     the results, so a post right after it notifies again and isn't lost.
+//
+// Usage:
+//     auto completions = CompletionQueue<Response>::create();
+//     // Register completions->fd() with EPOLLIN in the epoll loop
+//     dispatch_completion(pool, *completions, [request] {
+//         return handle(request); // Runs on a worker of pool
+//     });
+//
+//     // Epoll thread, once epoll_wait(...) reports completions->fd()
+//     for (Response& r: completions->drain()) {
+//         send(r);
+//     }
+template<class T>
+class CompletionQueue final {
+public:
+    // Returns nullptr if the eventfd can't be created
+    static std::unique_ptr<CompletionQueue> create() {
+        std::unique_ptr<EventNotifier> notifier = EventNotifier::create();
+        if (!notifier) {
+            return nullptr;
+        }
+        return std::unique_ptr<CompletionQueue>(
+            new CompletionQueue(std::move(notifier)));
+    }
+
+    ~CompletionQueue() = default;
+
+    // Runs on any thread
+    void post(T value) {
+        bool was_empty;
+        {
+            auto guard = completions.lock(); // Enter critical section
+            was_empty = guard.data().empty();
+            guard.data().push_back(std::move(value));
+        } // Leave critical section
+        if (was_empty) {
+            notifier->notify();
+        }
+    }
+
+    // Runs on the epoll thread. All the completions posted so far.
+    std::vector<T> drain() {
+        notifier->clear();
+        std::vector<T> values;
+        values.swap(completions.lock().data());
+        return values;
+    }
+
+    // Register it with EPOLLIN
+    int fd() const {
+        return notifier->fd();
+    }
+
+    // Disallowed operations
+    CompletionQueue(const CompletionQueue& other) = delete;
+    CompletionQueue(CompletionQueue&& other) = delete;
+    CompletionQueue& operator=(const CompletionQueue& other) = delete;
+    CompletionQueue& operator=(CompletionQueue&& other) = delete;
+
+private:
+    explicit CompletionQueue(std::unique_ptr<EventNotifier> n)
+        : notifier(std::move(n))
+        , completions(std::vector<T>()) {}
+
+    const std::unique_ptr<EventNotifier> notifier;
+    DataMutex<std::vector<T>> completions;
+};
+
+// Run f on queue and post its result to completions. completions must
+// outlive the task.
+template<class Queue, class T, class F>
+void dispatch_completion(Queue& queue, CompletionQueue<T>& completions, F f) {
+    queue.dispatch([&completions, f = std::move(f)]() mutable {
+        completions.post(f());
+    });
+}
+
+#endif // CompletionQueue_h
\ No newline at end of file
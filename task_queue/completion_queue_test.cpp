@@ -0,0 +1,61 @@
+#include "completion_queue.h"
+#include "task_queue.h"
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <iostream>
+#include <vector>
+
+const int REQUESTS = 1000;
+
+void test_completion_queue_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    auto completions = CompletionQueue<int>::create();
+    assert(completions);
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    assert(epoll_fd >= 0);
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    assert(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, completions->fd(), &ev) == 0);
+
+    // The workers square the requests, and this thread, as an epoll loop,
+    // takes the results in batches without any extra hop
+    TaskQueue pool(4);
+    for (int i = 0 ; i < REQUESTS ; ++i) {
+        dispatch_completion(pool, *completions, [i] {
+            return i * i;
+        });
+    }
+
+    std::vector<bool> seen(REQUESTS, false);
+    int received = 0;
+    int wakeups = 0;
+    while (received < REQUESTS) {
+        assert(epoll_wait(epoll_fd, &ev, 1, -1) == 1);
+        ++wakeups;
+        for (int square: completions->drain()) {
+            int i = 0;
+            while (i * i < square) {
+                ++i;
+            }
+            assert(!seen[i]);
+            seen[i] = true;
+            ++received;
+        }
+    }
+    std::cout << REQUESTS << " completions in " << wakeups << " wakeups"
+              << std::endl;
+
+    // Nothing left, so not readable anymore
+    assert(completions->drain().empty());
+    assert(epoll_wait(epoll_fd, &ev, 1, 0) == 0);
+    close(epoll_fd);
+}
+
+int main() {
+    test_completion_queue_example();
+    return 0;
+}
\ No newline at end of file
@@ -1,13 +1,34 @@
 #ifndef SimpleSerialTaskQueue_h
 #define SimpleSerialTaskQueue_h
 
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <condition_variable>
 #include <functional>
 #include <mutex>
 #include <queue>
 #include <thread>
+#include <memory>
 #include <utility>
+#include <vector>
+
+#include "cancellation.h"
+#include "timing_wheel.h"
+
+#ifdef CONTENTION_PROFILER
+#include "../profiler/contention_profiler.h"
+#endif
+
+#ifdef EXECUTION_TRACER
+#include "../profiler/execution_tracer.h"
+#endif
+
+// A hook recording an event for profiler/execution_tracer.h. Compiled out
+// unless EXECUTION_TRACER is defined.
+#ifndef EXECUTION_TRACE
+#define EXECUTION_TRACE(type, object)
+#endif
 
 // SimpleSerialTaskQueue
 //     A task queue that runs the tasks serially by the order they are
@@ -28,6 +49,17 @@
 //     // Without calling wait(), the value of number is unpredictable since we
 //     // don't know how many tasks are performed
 //     assert(number == 3);
+//
+// dispatch_after(delay, f) and dispatch_every(period, f) queue f later, or
+// periodically, from a TimerThread started at the first call. They can run on
+// any thread, and so can cancel(id). wait() doesn't wait for the timers that
+// haven't fired yet.
+//
+// dispatch(token, f) skips f if the CancellationToken is cancelled by the
+// time the worker gets to it. See cancellation.h.
+//
+// Define CONTENTION_PROFILER to record the queue depth, wait-to-run latency
+// and run time of the tasks into ContentionProfiler.
 class SimpleSerialTaskQueue final {
 public:
     // Main thread APIs
@@ -36,6 +68,9 @@ public:
     }
 
     ~SimpleSerialTaskQueue() {
+        // Stop the timers first, so no expired task comes in anymore
+        timers.reset();
+
         {
             std::lock_guard<std::mutex> guard(mutex); // Enter critical section
             assert(!destroyed);
@@ -57,13 +92,32 @@ public:
             assert(!destroyed);
             // wait() should be called on same thread
             assert(!waiting);
+#ifdef CONTENTION_PROFILER
+            queue.emplace(ContentionProfiler::profile_task(std::move(function),
+                ProfileMetric::SerialTaskQueueWaitToRun,
+                ProfileMetric::SerialTaskQueueRunTime));
+            ContentionProfiler::record(ProfileMetric::SerialTaskQueueDepth,
+                                       queue.size());
+#else
             queue.emplace(std::move(function));
+#endif
+            EXECUTION_TRACE(Enqueue, this);
         } // Leave critical section
 
         // Wake up the woker to perform the task if it's in waiting mode
         cv.notify_one();
     }
     
+    // Skip function if token is cancelled when the worker gets to it
+    template<class F>
+    void dispatch(const CancellationToken& token, F&& function) {
+        dispatch([token, function = std::forward<F>(function)]() mutable {
+            if (!token.is_cancelled()) {
+                function();
+            }
+        });
+    }
+
     // Block the current thread until all the tasks are done
     // dispatch() and wait() should run on the same thread so no more tasks
     // will be appended to the queue when wait() is blocking the thread.
@@ -83,6 +137,31 @@ public:
         waiting = false;
     }
 
+    // Queue function once delay has passed
+    template<class F>
+    TimerId dispatch_after(std::chrono::steady_clock::duration delay,
+                           F function) {
+        return timer_thread().schedule_after(delay, std::move(function));
+    }
+
+    // Queue function every period, starting one period from now
+    template<class F>
+    TimerId dispatch_every(std::chrono::steady_clock::duration period,
+                           F function) {
+        return timer_thread().schedule_every(period, std::move(function));
+    }
+
+    // Returns false if the timer has fired, unless it's periodic, or has been
+    // canceled already
+    bool cancel(TimerId id) {
+        // No timer has been scheduled if the timer thread isn't started, and
+        // there is no need to start it
+        if (!timers_running.load(std::memory_order_acquire)) {
+            return false;
+        }
+        return timers->cancel(id);
+    }
+
     // Disallowed operations
     SimpleSerialTaskQueue(const SimpleSerialTaskQueue& other) = delete;
 	SimpleSerialTaskQueue(SimpleSerialTaskQueue&& other) = delete;
@@ -90,6 +169,45 @@ public:
 	SimpleSerialTaskQueue& operator=(SimpleSerialTaskQueue&& other) = delete;
 
 private:
+    TimerThread& timer_thread() {
+        std::call_once(timers_started, [this] {
+            timers.reset(new TimerThread([this](std::vector<TimerThread::Task>&& tasks) {
+                dispatch_batch(std::move(tasks));
+            }));
+            timers_running.store(true, std::memory_order_release);
+        });
+        return *timers;
+    }
+
+    // Runs on timer thread. Move the expired tasks into the queue at once.
+    void dispatch_batch(std::vector<TimerThread::Task>&& tasks) {
+        {
+            std::lock_guard<std::mutex> guard(mutex); // Enter critical section
+            if (destroyed) {
+                return;
+            }
+            for (TimerThread::Task& task: tasks) {
+#ifdef CONTENTION_PROFILER
+                queue.emplace(ContentionProfiler::profile_task(std::move(task),
+                    ProfileMetric::SerialTaskQueueWaitToRun,
+                    ProfileMetric::SerialTaskQueueRunTime));
+#else
+                queue.emplace(std::move(task));
+#endif
+                EXECUTION_TRACE(Enqueue, this);
+            }
+#ifdef CONTENTION_PROFILER
+            ContentionProfiler::record(ProfileMetric::SerialTaskQueueDepth,
+                                       queue.size());
+#endif
+        } // Leave critical section
+
+        // Wake up the woker to perform the tasks if it's in waiting mode. The
+        // thread blocked by wait(), if any, shares the cv, so notify_one()
+        // might wake up that one instead.
+        cv.notify_all();
+    }
+
     // Perform the task in worker thread
     void work() {
         while (true) {
@@ -101,9 +219,14 @@ private:
             // }
             // Does same as above: queue and destroyed will be accessed only in
             // the critical section 
-            cv.wait(lock, [this]{
+            auto ready = [this]{
                 return queue.size() || destroyed;
-            });
+            };
+            if (!ready()) {
+                EXECUTION_TRACE(Park, this);
+                cv.wait(lock, ready);
+                EXECUTION_TRACE(Wake, this);
+            }
             // Now we are in the critical section
             
             if (destroyed) {
@@ -114,10 +237,13 @@ private:
             Task task = std::move(queue.front());
             // The queue.pop() will be called once the task is done
             // so !queue.empty() indicates there are pending or running tasks
+            EXECUTION_TRACE(Dequeue, this);
             lock.unlock(); // Leave critical section
 
             // Run the task on worker thread now
+            EXECUTION_TRACE(TaskStart, this);
             task();
+            EXECUTION_TRACE(TaskEnd, this);
 
             lock.lock(); // Enter critical section
             // The task is done. Remove it from the queue
@@ -150,6 +276,10 @@ private:
     std::condition_variable cv;
 
     std::thread worker;
+
+    std::once_flag timers_started;
+    std::unique_ptr<TimerThread> timers;
+    std::atomic<bool> timers_running {false}; // Set once timers is created
 };
 
 #endif // SimpleSerialTaskQueue_h
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <cassert>
 #include <chrono>
+#include <future>
 #include <iostream>
 #include <thread>
 
@@ -71,7 +72,19 @@ int main() {
         std::cout << "End task 7" << std::endl;
     });
 
-    std::this_thread::sleep_for (std::chrono::milliseconds(60));
+    // Canceling before any timer is scheduled doesn't start the timer thread
+    assert(!q.cancel(1));
+
+    // Timed tasks are queued by the timer thread, without holding the worker
+    std::promise<void> timed_task_done;
+    q.dispatch_after(std::chrono::milliseconds(20), [&]{
+        std::cout << "Run timed task" << std::endl;
+        timed_task_done.set_value();
+    });
+
+    // However late the timer thread is
+    timed_task_done.get_future().wait();
+    q.wait();
 
     // Without calling wait(), the value of number is unpredictable since we
     // don't know how many tasks are performed
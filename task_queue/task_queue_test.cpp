@@ -2,7 +2,10 @@
 
 #include <atomic>
 #include <cassert>
+#include <chrono>
+#include <future>
 #include <iostream>
+#include <thread>
 #include <vector>
 
 void test_queue_example() {
@@ -87,8 +90,138 @@ void test_serial_queue_example() {
     }
 }
 
+void test_timer_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    std::atomic<int> ticks(0);
+    std::atomic<bool> done(false);
+    {
+        // A single worker isn't held by the timers
+        TaskQueue q(1);
+        // Canceling before any timer is scheduled doesn't start the timer
+        // thread
+        assert(!q.cancel(1));
+
+        TimerId id = q.dispatch_every(std::chrono::milliseconds(5), [&] {
+            ++ticks;
+        });
+        q.dispatch_after(std::chrono::milliseconds(30), [&] {
+            std::cout << "Delayed task runs after " << ticks << " ticks"
+                      << std::endl;
+            done = true;
+        });
+        // Work dispatched now runs right away
+        assert(q.dispatch([] { return 1; }).get() == 1);
+
+        while (!done) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        assert(q.cancel(id));
+        assert(!q.cancel(id));
+        // A tick fired right before cancel(...) may still be on its way to
+        // the queue. A timer scheduled now is queued behind it, and the
+        // single worker runs them in order.
+        std::promise<void> drained;
+        q.dispatch_after(std::chrono::milliseconds(1), [&] {
+            drained.set_value();
+        });
+        drained.get_future().wait();
+        int runs = ticks;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        assert(ticks == runs);
+    }
+}
+
+void test_elastic_queue_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    TaskQueue q(1, 2, std::chrono::milliseconds(20));
+    assert(q.worker_count() == 1);
+
+    // The backlog spawns workers up to max_threads
+    std::vector<std::future<void>> results;
+    for (int i = 0 ; i < 8 ; ++i) {
+        results.push_back(q.dispatch([] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }));
+    }
+    for (auto& result: results) {
+        result.get();
+    }
+    std::cout << "Workers after the backlog: " << q.worker_count() << std::endl;
+    assert(q.worker_count() <= 2);
+
+    // The blocked tasks don't count toward max_threads. All 4 tasks wait for
+    // each other, which only works if they all run at once.
+    std::atomic<int> started(0);
+    results.clear();
+    for (int i = 0 ; i < 4 ; ++i) {
+        results.push_back(q.dispatch([&] {
+            TaskQueue::BlockingRegion region;
+            ++started;
+            while (started < 4) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }));
+    }
+    for (auto& result: results) {
+        result.get();
+    }
+    std::cout << "Workers after the blocking tasks: " << q.worker_count()
+              << std::endl;
+    assert(q.worker_count() >= 4);
+
+    // The extra workers retire after idling
+    while (q.worker_count() > 1) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    std::cout << "Workers after idling: " << q.worker_count() << std::endl;
+    assert(q.dispatch([] { return 1; }).get() == 1);
+}
+
+void test_blocking_ceiling_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    // Many more tasks block at once than the queue may have workers: 2
+    // workers and 3 replacements for the blocked ones run 5 of them, and the
+    // rest wait in the queue until those unblock
+    const size_t CEILING = 2 + 3;
+    const int TASKS = 50;
+    TaskQueue q(1, 2, std::chrono::milliseconds(20), 3);
+    std::promise<void> unblock;
+    std::shared_future<void> unblocked(unblock.get_future());
+    std::atomic<size_t> started(0);
+    std::vector<std::future<void>> results;
+    for (int i = 0 ; i < TASKS ; ++i) {
+        results.push_back(q.dispatch([&started, unblocked] {
+            TaskQueue::BlockingRegion region;
+            ++started;
+            unblocked.wait();
+        }));
+    }
+    while (started < CEILING) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    // Give the queue the time to spawn more workers, if it would
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::cout << "Workers with " << TASKS << " blocking tasks: "
+              << q.worker_count() << std::endl;
+    assert(q.worker_count() <= CEILING);
+    assert(started == CEILING);
+
+    unblock.set_value();
+    for (auto& result: results) {
+        result.get();
+    }
+    assert(started == TASKS);
+    assert(q.worker_count() <= CEILING);
+}
+
 int main() {
     test_queue_example();
     test_serial_queue_example();
+    test_timer_example();
+    test_elastic_queue_example();
+    test_blocking_ceiling_example();
 	return 0;
 }
\ No newline at end of file
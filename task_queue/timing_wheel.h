@@ -0,0 +1,421 @@
+#ifndef TimingWheel_h
+#define TimingWheel_h
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// The handle of a scheduled timer. 0 is never a valid one.
+typedef uint64_t TimerId;
+
+// TimingWheel
+//     A hierarchical timing wheel [1] keeping the timers by their deadlines,
+//     counted in ticks. It isn't thread-safe. See TimerThread below for the
+//     thread running it.
+//
+//     There are LEVELS wheels of SLOTS slots. A slot of the level-l wheel
+//     covers SLOTS^l ticks, so the wheels together cover SLOTS^LEVELS ticks.
+//     A timer is put in the slot of the highest level where its deadline
+//     differs from the current tick. When the current tick enters a new slot
+//     of a level-l wheel, the timers in that slot are cascaded down to the
+//     lower levels, and the level-0 slot of the current tick holds the timers
+//     expiring now.
+//
+//           level 2          level 1          level 0
+//     +---+---+---+---+ +---+---+---+---+ +---+---+---+---+
+//     |   | * |   |   | |   |   | * |   | | * |   | * |   |
+//     +---+---+---+---+ +---+---+---+---+ +---+---+---+---+
+//           |                   |           ^
+//           +-- cascades to --> +-- to ---> now
+//
+//     Scheduling and canceling a timer are O(1): it's a node in an intrusive
+//     doubly linked list of its slot. The nodes live in a slab, a vector
+//     reused through a free list, so scheduling doesn't allocate once the
+//     slab is big enough. A TimerId carries the node index and a generation
+//     number, so an id of a fired or canceled timer doesn't cancel the next
+//     timer taking the node.
+//
+// Usage:
+//     TimingWheel wheel;
+//     TimerId id = wheel.schedule(10, [] { ... }); // Fire at tick 10
+//     wheel.cancel(id); // Or cancel it before it fires
+//     std::vector<TimingWheel::Task> expired;
+//     wheel.advance(10, expired); // Collect the tasks expired by tick 10
+//
+// [1] George Varghese and Tony Lauck, Hashed and hierarchical timing wheels:
+//     data structures for the efficient implementation of a timer facility,
+//     1987
+class TimingWheel final {
+public:
+    typedef std::function<void()> Task;
+
+    static constexpr uint64_t NEVER = std::numeric_limits<uint64_t>::max();
+
+    static constexpr unsigned BITS = 6;
+    static constexpr uint32_t SLOTS = 1 << BITS;
+    static constexpr unsigned LEVELS = 6;
+
+    explicit TimingWheel(uint64_t now = 0): current(now), count(0) {
+        std::fill(std::begin(heads), std::end(heads), NONE);
+    }
+
+    ~TimingWheel() = default;
+
+    // Run task at deadline, and every period ticks after that if period is
+    // not 0. A deadline that has passed fires at the next tick.
+    TimerId schedule(uint64_t deadline, Task task, uint64_t period = 0) {
+        uint32_t index;
+        if (free_nodes.empty()) {
+            index = nodes.size();
+            nodes.emplace_back();
+        } else {
+            index = free_nodes.back();
+            free_nodes.pop_back();
+        }
+        Node& node = nodes[index];
+        node.deadline = std::max(deadline, current + 1);
+        node.period = period;
+        node.task = std::move(task);
+        node.scheduled = true;
+        place(index);
+        ++count;
+        return make_id(index, node.generation);
+    }
+
+    // Returns false if the timer has fired, unless it's periodic, or has been
+    // canceled already
+    bool cancel(TimerId id) {
+        uint32_t index = static_cast<uint32_t>(id);
+        if (index >= nodes.size()) {
+            return false;
+        }
+        Node& node = nodes[index];
+        if (!node.scheduled || node.generation != (id >> 32)) {
+            return false;
+        }
+        unlink(index);
+        release(index);
+        return true;
+    }
+
+    // Move the current tick forward to now and append the tasks of the
+    // expired timers to expired, tick by tick. The periodic timers are
+    // scheduled again for their next period after now, so a timer that has
+    // missed several periods fires only once.
+    void advance(uint64_t now, std::vector<Task>& expired) {
+        if (count == 0) {
+            current = std::max(current, now);
+            return;
+        }
+        while (current < now) {
+            ++current;
+            // Cascade from the top, so the timers moved down a level can be
+            // cascaded again in the same tick
+            for (unsigned level = LEVELS - 1 ; level > 0 ; --level) {
+                if (current & ((uint64_t(1) << (BITS * level)) - 1)) {
+                    continue;
+                }
+                uint32_t slot = level * SLOTS + ((current >> (BITS * level)) & (SLOTS - 1));
+                uint32_t index = take_slot(slot);
+                while (index != NONE) {
+                    uint32_t next = nodes[index].next;
+                    place(index);
+                    index = next;
+                }
+            }
+            uint32_t index = take_slot(current & (SLOTS - 1));
+            while (index != NONE) {
+                uint32_t next = nodes[index].next;
+                expire(index, now, expired);
+                index = next;
+            }
+        }
+    }
+
+    // The first tick after now() where advance(...) has something to do: a
+    // timer expiring, or a slot to cascade, which may not expire anything
+    // yet. NEVER if no timer is scheduled. Scans the slots, O(LEVELS * SLOTS).
+    uint64_t next_tick() const {
+        if (count == 0) {
+            return NEVER;
+        }
+        uint64_t next = NEVER;
+        for (unsigned level = 0 ; level < LEVELS ; ++level) {
+            unsigned shift = BITS * level;
+            uint64_t position = (current >> shift) & (SLOTS - 1);
+            for (uint32_t i = 0 ; i < SLOTS ; ++i) {
+                if (heads[level * SLOTS + i] == NONE) {
+                    continue;
+                }
+                // The tick entering slot i of this level: in this turn of
+                // the wheel if it's still ahead, or in the next turn
+                uint64_t turn = current >> shift >> BITS;
+                if (i <= position) {
+                    ++turn;
+                }
+                uint64_t tick = ((turn << BITS) | i) << shift;
+                next = std::min(next, tick);
+            }
+        }
+        return next;
+    }
+
+    // The number of scheduled timers
+    size_t size() const {
+        return count;
+    }
+
+    uint64_t now() const {
+        return current;
+    }
+
+    // Disallowed operations
+    TimingWheel(const TimingWheel& other) = delete;
+    TimingWheel(TimingWheel&& other) = delete;
+    TimingWheel& operator=(const TimingWheel& other) = delete;
+    TimingWheel& operator=(TimingWheel&& other) = delete;
+
+private:
+    static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+    struct Node {
+        uint64_t deadline = 0;
+        uint64_t period = 0;
+        Task task;
+        uint32_t prev = NONE;
+        uint32_t next = NONE;
+        uint32_t slot = NONE;
+        uint32_t generation = 1;
+        bool scheduled = false;
+    };
+
+    static TimerId make_id(uint32_t index, uint32_t generation) {
+        return (static_cast<uint64_t>(generation) << 32) | index;
+    }
+
+    // Put a node into the slot of the highest level where its deadline
+    // differs from the current tick
+    void place(uint32_t index) {
+        Node& node = nodes[index];
+        uint64_t diff = node.deadline ^ current;
+        unsigned level = 0;
+        while (level + 1 < LEVELS && (diff >> (BITS * (level + 1)))) {
+            ++level;
+        }
+        // A deadline beyond the range of the top wheel goes to the top wheel
+        // anyway, and gets placed again each time its slot is cascaded
+        uint32_t slot = level * SLOTS + ((node.deadline >> (BITS * level)) & (SLOTS - 1));
+        node.slot = slot;
+        node.prev = NONE;
+        node.next = heads[slot];
+        if (node.next != NONE) {
+            nodes[node.next].prev = index;
+        }
+        heads[slot] = index;
+    }
+
+    void unlink(uint32_t index) {
+        Node& node = nodes[index];
+        if (node.prev != NONE) {
+            nodes[node.prev].next = node.next;
+        } else {
+            heads[node.slot] = node.next;
+        }
+        if (node.next != NONE) {
+            nodes[node.next].prev = node.prev;
+        }
+    }
+
+    // Detach the whole list of a slot and return its first node
+    uint32_t take_slot(uint32_t slot) {
+        uint32_t index = heads[slot];
+        heads[slot] = NONE;
+        return index;
+    }
+
+    // Hand out the task of an expired timer. A periodic timer is placed
+    // again for its first period after now, the tick advance() goes to.
+    void expire(uint32_t index, uint64_t now, std::vector<Task>& expired) {
+        Node& node = nodes[index];
+        if (node.deadline > current) {
+            // Placed at the top level from too far away. Not its time yet.
+            place(index);
+            return;
+        }
+        if (!node.period) {
+            expired.emplace_back(std::move(node.task));
+            release(index);
+            return;
+        }
+        expired.emplace_back(node.task);
+        uint64_t missed = (now - node.deadline) / node.period;
+        node.deadline += (missed + 1) * node.period;
+        place(index);
+    }
+
+    void release(uint32_t index) {
+        Node& node = nodes[index];
+        node.task = nullptr;
+        node.scheduled = false;
+        ++node.generation;
+        free_nodes.push_back(index);
+        --count;
+    }
+
+    uint64_t current; // The current tick
+    size_t count;
+    uint32_t heads[LEVELS * SLOTS];
+    std::vector<Node> nodes; // The slab
+    std::vector<uint32_t> free_nodes;
+};
+
+// TimerThread
+//     Runs a TimingWheel on its own thread, so the timers don't hold up any
+//     worker. The expired tasks of each tick are handed to the dispatch
+//     function given at construction in one batch, e.g., to push them into a
+//     task queue under one lock. The thread sleeps until the next tick where
+//     the wheel has something to do, or for good while no timer is
+//     scheduled, so a timer far away costs a few wakeups rather than one per
+//     tick.
+//
+//     schedule_after(...), schedule_every(...) and cancel(...) can run on any
+//     thread. The dispatch function runs on the timer thread.
+//
+// Usage:
+//     TimerThread timers([&](std::vector<TimerThread::Task>&& tasks) {
+//         for (auto& task: tasks) {
+//             task();
+//         }
+//     });
+//     TimerId id = timers.schedule_every(std::chrono::milliseconds(100), f);
+//     timers.cancel(id);
+class TimerThread final {
+public:
+    typedef TimingWheel::Task Task;
+    typedef std::function<void(std::vector<Task>&&)> Dispatch;
+    typedef std::chrono::steady_clock Clock;
+
+    explicit TimerThread(Dispatch dispatch,
+                         Clock::duration resolution = std::chrono::milliseconds(1))
+        : start(Clock::now())
+        , tick(resolution)
+        , dispatch_batch(std::move(dispatch))
+        , wake_tick(TimingWheel::NEVER)
+        , stopped(false) {
+        assert(resolution.count() > 0);
+        thread = std::thread(&TimerThread::run, this);
+    }
+
+    ~TimerThread() {
+        {
+            std::lock_guard<std::mutex> guard(mutex); // Enter critical section
+            stopped = true; // Drop the pending timers
+        } // Leave critical section
+        cv.notify_one();
+        thread.join();
+    }
+
+    // Runs on any thread
+    TimerId schedule_after(Clock::duration delay, Task task) {
+        return schedule(delay, std::move(task), Clock::duration::zero());
+    }
+
+    // Runs on any thread. The first run is one period from now.
+    TimerId schedule_every(Clock::duration period, Task task) {
+        assert(period.count() > 0);
+        return schedule(period, std::move(task), period);
+    }
+
+    // Runs on any thread. Returns false if the timer has fired, unless it's
+    // periodic, or has been canceled already.
+    bool cancel(TimerId id) {
+        std::lock_guard<std::mutex> guard(mutex); // Enter critical section
+        return wheel.cancel(id);
+    } // Leave critical section
+
+    // Disallowed operations
+    TimerThread(const TimerThread& other) = delete;
+    TimerThread(TimerThread&& other) = delete;
+    TimerThread& operator=(const TimerThread& other) = delete;
+    TimerThread& operator=(TimerThread&& other) = delete;
+
+private:
+    TimerId schedule(Clock::duration delay, Task task, Clock::duration period) {
+        bool wakeup;
+        TimerId id;
+        {
+            std::lock_guard<std::mutex> guard(mutex); // Enter critical section
+            // Round up, so a task never runs before its delay
+            uint64_t deadline = ticks_at(Clock::now() + delay + tick - Clock::duration(1));
+            uint64_t period_ticks = (period + tick - Clock::duration(1)) / tick;
+            id = wheel.schedule(deadline, std::move(task), period_ticks);
+            // Wake the timer thread up if it sleeps past the new deadline
+            deadline = std::max(deadline, wheel.now() + 1);
+            wakeup = deadline < wake_tick;
+            if (wakeup) {
+                wake_tick = deadline;
+            }
+        } // Leave critical section
+        if (wakeup) {
+            cv.notify_one();
+        }
+        return id;
+    }
+
+    // Runs on timer thread
+    void run() {
+        std::vector<Task> expired;
+        std::unique_lock<std::mutex> lock(mutex); // Enter critical section
+        while (true) {
+            uint64_t next = wheel.next_tick();
+            wake_tick = next;
+            // Woken up early by a timer scheduled before next
+            auto woken = [this, next] {
+                return stopped || wake_tick < next;
+            };
+            if (next == TimingWheel::NEVER) {
+                cv.wait(lock, woken);
+            } else {
+                cv.wait_until(lock, start + next * tick, woken);
+            }
+            if (stopped) {
+                break;
+            }
+            wheel.advance(ticks_at(Clock::now()), expired);
+            if (expired.empty()) {
+                continue;
+            }
+            lock.unlock(); // Leave critical section
+            dispatch_batch(std::move(expired));
+            expired.clear();
+            lock.lock(); // Enter critical section
+        }
+    }
+
+    uint64_t ticks_at(Clock::time_point t) const {
+        return t <= start ? 0 : (t - start) / tick;
+    }
+
+    const Clock::time_point start;
+    const Clock::duration tick;
+    const Dispatch dispatch_batch;
+
+    std::mutex mutex;
+    TimingWheel wheel; // Protected by mutex
+    uint64_t wake_tick; // The tick the thread sleeps until. Protected by mutex
+    bool stopped; // Protected by mutex
+
+    std::condition_variable cv;
+
+    std::thread thread;
+};
+
+#endif // TimingWheel_h
\ No newline at end of file
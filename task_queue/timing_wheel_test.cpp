@@ -0,0 +1,192 @@
+#include "timing_wheel.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+void test_timing_wheel_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    TimingWheel wheel;
+    std::vector<uint64_t> fired;
+    auto task = [&fired](uint64_t deadline) {
+        return [&fired, deadline] { fired.push_back(deadline); };
+    };
+
+    // Deadlines on every level, scheduled out of order
+    std::vector<uint64_t> deadlines = { 5000000, 3, 64, 4096, 70, 1, 262145, 63 };
+    for (uint64_t d: deadlines) {
+        wheel.schedule(d, task(d));
+    }
+    TimerId canceled = wheel.schedule(100, task(100));
+    assert(wheel.cancel(canceled));
+    assert(!wheel.cancel(canceled));
+    assert(wheel.size() == deadlines.size());
+
+    // Each timer fires exactly at its tick
+    std::vector<TimingWheel::Task> expired;
+    for (uint64_t now = 1 ; now <= 5000000 ; ++now) {
+        wheel.advance(now, expired);
+        for (TimingWheel::Task& t: expired) {
+            t();
+            assert(fired.back() == now);
+        }
+        expired.clear();
+    }
+    assert(fired == std::vector<uint64_t>({ 1, 3, 63, 64, 70, 4096, 262145, 5000000 }));
+    assert(wheel.size() == 0);
+    std::cout << "fired " << fired.size() << " timers in order" << std::endl;
+}
+
+void test_next_tick_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    TimingWheel wheel;
+    assert(wheel.next_tick() == TimingWheel::NEVER);
+    std::vector<uint64_t> fired;
+    std::vector<uint64_t> deadlines = { 5000000, 3, 64, 4096, 70, 1, 262145, 63 };
+    for (uint64_t d: deadlines) {
+        wheel.schedule(d, [&fired, d] { fired.push_back(d); });
+    }
+
+    // Jump from one next_tick() to the next rather than tick by tick. Some
+    // of them only cascade a slot.
+    std::vector<TimingWheel::Task> expired;
+    size_t jumps = 0;
+    while (wheel.size()) {
+        uint64_t next = wheel.next_tick();
+        assert(next > wheel.now());
+        wheel.advance(next, expired);
+        for (TimingWheel::Task& t: expired) {
+            t();
+            assert(fired.back() == next);
+        }
+        expired.clear();
+        ++jumps;
+    }
+    assert(fired == std::vector<uint64_t>({ 1, 3, 63, 64, 70, 4096, 262145, 5000000 }));
+    assert(wheel.next_tick() == TimingWheel::NEVER);
+    assert(jumps < 50);
+    std::cout << "fired " << fired.size() << " timers in " << jumps
+              << " jumps" << std::endl;
+}
+
+void test_periodic_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    TimingWheel wheel;
+    int runs = 0;
+    TimerId id = wheel.schedule(10, [&runs] { ++runs; }, 10);
+
+    std::vector<TimingWheel::Task> expired;
+    for (uint64_t now = 1 ; now <= 35 ; ++now) {
+        wheel.advance(now, expired);
+    }
+    // Fired at 10, 20 and 30
+    assert(expired.size() == 3);
+    expired.clear();
+
+    // A big jump fires it once and skips the missed periods
+    wheel.advance(1000, expired);
+    assert(expired.size() == 1);
+    expired.clear();
+    wheel.advance(1009, expired);
+    assert(expired.empty());
+    wheel.advance(1010, expired);
+    assert(expired.size() == 1);
+
+    // A periodic timer stays cancelable after firing
+    assert(wheel.cancel(id));
+    expired.clear();
+    wheel.advance(2000, expired);
+    assert(expired.empty());
+
+    // The node is reused by the next timer, but the stale id can't touch it
+    TimerId other = wheel.schedule(2010, [] {});
+    assert(static_cast<uint32_t>(other) == static_cast<uint32_t>(id));
+    assert(!wheel.cancel(id));
+    assert(wheel.cancel(other));
+    std::cout << "ok" << std::endl;
+}
+
+void test_many_timers_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    const size_t TIMERS = 300000;
+    TimingWheel wheel;
+    std::vector<TimerId> ids;
+    size_t fired = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0 ; i < TIMERS ; ++i) {
+        ids.push_back(wheel.schedule(1 + (i * 7919) % 100000, [&fired] { ++fired; }));
+    }
+    // Cancel every other one, like timeouts of completed requests
+    for (size_t i = 0 ; i < TIMERS ; i += 2) {
+        assert(wheel.cancel(ids[i]));
+    }
+    std::vector<TimingWheel::Task> expired;
+    wheel.advance(100000, expired);
+    for (TimingWheel::Task& t: expired) {
+        t();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    assert(fired == TIMERS / 2);
+    assert(wheel.size() == 0);
+    std::cout << TIMERS << " timers scheduled, half canceled, in "
+              << elapsed.count() << " ms" << std::endl;
+}
+
+void test_timer_thread_example() {
+    std::cout << "\n----- " << __func__ << " -----" << std::endl;
+
+    std::atomic<int> once(0);
+    std::atomic<int> periodic(0);
+    std::atomic<size_t> batches(0);
+    {
+        TimerThread timers([&](std::vector<TimerThread::Task>&& tasks) {
+            ++batches;
+            for (TimerThread::Task& task: tasks) {
+                task();
+            }
+        });
+        auto start = std::chrono::steady_clock::now();
+        std::atomic<bool> done(false);
+        timers.schedule_after(std::chrono::milliseconds(20), [&] {
+            ++once;
+            // Never earlier than asked
+            assert(std::chrono::steady_clock::now() - start >=
+                   std::chrono::milliseconds(20));
+            done = true;
+        });
+        TimerId id = timers.schedule_every(std::chrono::milliseconds(5),
+                                           [&] { ++periodic; });
+        TimerId canceled = timers.schedule_after(std::chrono::milliseconds(10),
+                                                 [&] { assert(false); });
+        assert(timers.cancel(canceled));
+        while (!done) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        assert(timers.cancel(id));
+        int runs = periodic;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        assert(periodic == runs);
+        // Dropped when timers is destroyed
+        timers.schedule_after(std::chrono::seconds(10), [&] { ++once; });
+    }
+    assert(once == 1);
+    std::cout << "periodic timer ran " << periodic << " times in "
+              << batches << " batches" << std::endl;
+}
+
+int main() {
+    test_timing_wheel_example();
+    test_next_tick_example();
+    test_periodic_example();
+    test_many_timers_example();
+    test_timer_thread_example();
+    return 0;
+}
\ No newline at end of file